@@ -0,0 +1,192 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Writes a synthetic Monicelli program on stdout, to benchmark the compiler
+ * on sources of any size. The program is valid, but it is not meant to be
+ * run: loops are bounded, calls are not.
+ *
+ * Usage: mc-generate [--functions N] [--depth N] [--expression N]
+ *                    [--statements N] [--seed N]
+ */
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace po = boost::program_options;
+
+namespace {
+
+struct Options {
+    unsigned functions;
+    unsigned depth;
+    unsigned expression;
+    unsigned statements;
+};
+
+class Generator {
+public:
+    Generator(Options const& options, unsigned seed):
+        options(options), random(seed) {}
+
+    void program(std::ostream &out) {
+        for (unsigned i = 0; i < options.functions; ++i) {
+            function(out, i);
+        }
+
+        out << "Lei ha clacsonato\n";
+        out << "voglio risultato, Necchi come se fosse 0\n";
+        for (unsigned i = 0; i < options.functions; ++i) {
+            out << "risultato come fosse risultato più " << call(i, "risultato") << '\n';
+        }
+        out << "risultato a posterdati\n";
+    }
+
+private:
+    static unsigned arity(unsigned function) {
+        return function % 3 + 1;
+    }
+
+    unsigned pick(unsigned bound) {
+        return std::uniform_int_distribution<unsigned>(0, bound - 1)(random);
+    }
+
+    std::string call(unsigned function, std::string const& argument) {
+        std::ostringstream text;
+        text << "prematurata la supercazzola funzione" << function << " con ";
+        for (unsigned i = 0; i < arity(function); ++i) {
+            text << (i > 0? ", ": "") << argument;
+        }
+        text << " o scherziamo?";
+        return text.str();
+    }
+
+    std::string expression(std::vector<std::string> const& names) {
+        static char const *const OPERATORS[] = {"più", "meno", "per"};
+
+        std::ostringstream text;
+        text << names[pick(names.size())];
+        for (unsigned i = 1; i < options.expression; ++i) {
+            text << ' ' << OPERATORS[pick(3)] << ' ';
+            if (pick(2) == 0) {
+                text << pick(100);
+            } else {
+                text << names[pick(names.size())];
+            }
+        }
+        return text.str();
+    }
+
+    void block(std::ostream &out, std::vector<std::string> names, unsigned depth, unsigned function) {
+        std::string indent(2 * (options.depth - depth + 1), ' ');
+
+        for (unsigned i = 0; i < options.statements; ++i) {
+            std::string name = "v" + std::to_string(depth) + "x" + std::to_string(i);
+            out << indent << "voglio " << name << ", Necchi come se fosse "
+                << expression(names) << '\n';
+            names.push_back(name);
+        }
+
+        if (function > 0 && pick(2) == 0) {
+            out << indent << names.back() << " come fosse "
+                << call(pick(function), names[pick(names.size())]) << '\n';
+        }
+
+        if (depth == 0) return;
+
+        std::string counter = "contatore" + std::to_string(depth);
+        std::string const& subject = names.back();
+
+        if (depth % 2 == 0) {
+            out << indent << "voglio " << counter << ", Necchi come se fosse 0\n";
+            out << indent << "stuzzica\n";
+            block(out, names, depth - 1, function);
+            out << indent << counter << " come fosse " << counter << " più 1\n";
+            out << indent << "e brematura anche, se " << counter << " minore di 3\n";
+        } else {
+            out << indent << "che cos'è " << subject << "?\n";
+            out << indent << "minore di " << pick(50) << ":\n";
+            block(out, names, depth - 1, function);
+            out << indent << "o magari " << pick(100) << ":\n";
+            out << indent << "  " << subject << " come fosse " << expression(names) << '\n';
+            out << indent << "o tarapia tapioco:\n";
+            block(out, names, depth - 1, function);
+            out << indent << "e velocità di esecuzione\n";
+        }
+    }
+
+    void function(std::ostream &out, unsigned index) {
+        std::vector<std::string> names;
+
+        out << "blinda la supercazzola Necchi funzione" << index << " con ";
+        for (unsigned i = 0; i < arity(index); ++i) {
+            std::string name = "argomento" + std::to_string(i);
+            out << (i > 0? ", ": "") << name << " Necchi";
+            names.push_back(name);
+        }
+        out << " o scherziamo?\n";
+
+        block(out, names, options.depth, index);
+
+        out << "  vaffanzum " << expression(names) << "!\n\n";
+    }
+
+    Options options;
+    std::mt19937 random;
+};
+
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    unsigned seed;
+
+    po::options_description desc("Usage: mc-generate [options] > program.mc");
+    desc.add_options()
+        ("help,h", "display this help message")
+        ("functions", po::value<unsigned>(&options.functions)->default_value(100), "number of functions")
+        ("depth", po::value<unsigned>(&options.depth)->default_value(4), "nesting of loops and branches in each function")
+        ("expression", po::value<unsigned>(&options.expression)->default_value(8), "operands in each expression")
+        ("statements", po::value<unsigned>(&options.statements)->default_value(3), "declarations in each block")
+        ("seed", po::value<unsigned>(&seed)->default_value(42), "random seed, same seed same program")
+    ;
+
+    po::variables_map config;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), config);
+        po::notify(config);
+    } catch (po::error const& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    if (config.count("help") || options.expression == 0) {
+        std::cout << desc;
+        return 0;
+    }
+
+    Generator(options, seed).program(std::cout);
+
+    return 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Measures mcc and the code it generates, and writes the results as JSON.
+ *
+ * The compile benchmark feeds mcc synthetic programs from mc-generate and
+ * reports throughput and peak memory of the C++ and bitcode backends. The
+ * runtime benchmark builds executables from some of the examples at each
+ * optimization level and times them. Every measure runs in a child
+ * process, its peak memory comes from wait4().
+ */
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = boost::filesystem;
+namespace po = boost::program_options;
+
+namespace {
+
+struct Measure {
+    bool success;
+    double seconds;
+    long peakRssKiB;
+};
+
+Measure spawn(std::vector<std::string> const& argv, fs::path const& directory,
+              std::string const& input, std::string const& output) {
+    auto start = std::chrono::steady_clock::now();
+    pid_t child = fork();
+
+    if (child == 0) {
+        std::vector<char*> args;
+        for (std::string const& arg: argv) {
+            args.push_back(const_cast<char*>(arg.c_str()));
+        }
+        args.push_back(nullptr);
+
+        int in = open(input.empty()? "/dev/null": input.c_str(), O_RDONLY);
+        int out = open(output.empty()? "/dev/null": output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (in < 0 || out < 0 || chdir(directory.c_str()) != 0) _exit(127);
+
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+
+        execvp(args[0], args.data());
+        _exit(127);
+    }
+
+    int status = 0;
+    rusage usage;
+    if (child < 0 || wait4(child, &status, 0, &usage) != child) {
+        return {false, 0, 0};
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    bool success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+#ifdef __APPLE__
+    long rss = usage.ru_maxrss / 1024;
+#else
+    long rss = usage.ru_maxrss;
+#endif
+
+    return {success, elapsed.count(), rss};
+}
+
+/** Fastest of repeat runs, peak memory of the worst. */
+Measure best(unsigned repeat, std::function<Measure()> run) {
+    Measure result = {true, 0, 0};
+
+    for (unsigned i = 0; i < repeat; ++i) {
+        Measure m = run();
+        if (!m.success) return m;
+
+        result.seconds = i == 0? m.seconds: std::min(result.seconds, m.seconds);
+        result.peakRssKiB = std::max(result.peakRssKiB, m.peakRssKiB);
+    }
+
+    return result;
+}
+
+size_t countLines(fs::path const& file) {
+    std::ifstream stream(file.native());
+    return std::count(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>(), '\n');
+}
+
+struct Config {
+    std::string mcc;
+    std::string generator;
+    std::string examples;
+    std::string runtimePath;
+    std::vector<unsigned> sizes;
+    unsigned repeat;
+};
+
+struct Backend {
+    char const *name;
+    char const *flag;
+};
+
+static const Backend BACKENDS[] = {
+    {"c++", "--c++"},
+    {"bitcode", nullptr},
+};
+
+struct Example {
+    char const *name;
+    char const *input;
+};
+
+// Inputs are picked so that results fit in 64 bits.
+static const Example EXAMPLES[] = {
+    {"mandelbrot", ""},
+    {"primes", ""},
+    {"fibonacci", "90\n"},
+    {"factorial", "20\n"},
+};
+
+bool compileBenchmark(Config const& config, fs::path const& work, std::ostream &json) {
+    bool first = true;
+    json << "  \"compile\": [\n";
+
+    for (unsigned size: config.sizes) {
+        fs::path source = work / ("generated" + std::to_string(size) + ".mc");
+        Measure generated = spawn({
+            config.generator, "--functions", std::to_string(size)
+        }, work, "", source.native());
+
+        if (!generated.success) {
+            std::cerr << "mc-generate failed" << std::endl;
+            return false;
+        }
+
+        size_t lines = countLines(source);
+
+        for (Backend const& backend: BACKENDS) {
+            std::vector<std::string> command = {config.mcc};
+            if (backend.flag != nullptr) command.push_back(backend.flag);
+            command.push_back(source.native());
+
+            Measure m = best(config.repeat, [&]() { return spawn(command, work, "", ""); });
+            if (!m.success) {
+                std::cerr << "mcc failed on " << source.native() << std::endl;
+                return false;
+            }
+
+            json << (first? "": ",\n") << "    {\"backend\": \"" << backend.name
+                 << "\", \"functions\": " << size << ", \"lines\": " << lines
+                 << ", \"seconds\": " << m.seconds
+                 << ", \"lines_per_second\": " << lines / m.seconds
+                 << ", \"peak_rss_kib\": " << m.peakRssKiB << '}';
+            first = false;
+
+            std::cerr << backend.name << ", " << lines << " lines: "
+                      << lines / m.seconds << " lines/s, " << m.peakRssKiB << " KiB" << std::endl;
+        }
+    }
+
+    json << "\n  ]";
+    return true;
+}
+
+bool runtimeBenchmark(Config const& config, fs::path const& work, std::ostream &json) {
+    bool first = true;
+    json << "  \"runtime\": [\n";
+
+    for (Example const& example: EXAMPLES) {
+        fs::path source = fs::path(config.examples) / (std::string(example.name) + ".mc");
+        fs::path input = work / (std::string(example.name) + ".in");
+        std::ofstream(input.native()) << example.input;
+
+        for (unsigned level = 0; level <= 3; ++level) {
+            Measure built = spawn({
+                config.mcc, "--exe", "-O" + std::to_string(level),
+                "--runtime-path", config.runtimePath, fs::absolute(source).native()
+            }, work, "", "");
+
+            if (!built.success) {
+                std::cerr << "mcc --exe failed on " << source.native() << std::endl;
+                return false;
+            }
+
+            std::string binary = (work / example.name).native();
+            Measure m = best(config.repeat, [&]() {
+                return spawn({binary}, work, input.native(), "");
+            });
+
+            if (!m.success) {
+                std::cerr << example.name << " failed at -O" << level << std::endl;
+                return false;
+            }
+
+            json << (first? "": ",\n") << "    {\"program\": \"" << example.name
+                 << "\", \"level\": " << level << ", \"seconds\": " << m.seconds
+                 << ", \"peak_rss_kib\": " << m.peakRssKiB << '}';
+            first = false;
+
+            std::cerr << example.name << " -O" << level << ": " << m.seconds * 1e3 << " ms" << std::endl;
+        }
+    }
+
+    json << "\n  ]";
+    return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Config config;
+    std::string output;
+
+    po::options_description desc("Usage: mcc-benchmark --mcc PATH --generator PATH [options]");
+    desc.add_options()
+        ("help,h", "display this help message")
+        ("mcc", po::value<std::string>(&config.mcc)->required(), "compiler to measure")
+        ("generator", po::value<std::string>(&config.generator)->required(), "path of mc-generate")
+        ("examples", po::value<std::string>(&config.examples)->default_value("examples"), "directory with the example programs")
+        ("runtime-path", po::value<std::string>(&config.runtimePath)->default_value("."), "directory with libmcrt, for the runtime benchmark")
+        ("sizes", po::value<std::vector<unsigned>>(&config.sizes)->multitoken(), "functions in each generated program (default: 100 1000 5000)")
+        ("repeat", po::value<unsigned>(&config.repeat)->default_value(3), "runs of each measure, the fastest is kept")
+        ("skip-runtime", "only run the compile benchmark")
+        ("output,o", po::value<std::string>(&output), "write the JSON results here instead of stdout")
+    ;
+
+    po::variables_map options;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), options);
+        if (options.count("help")) {
+            std::cout << desc;
+            return 0;
+        }
+        po::notify(options);
+    } catch (po::error const& error) {
+        std::cerr << error.what() << '\n' << desc;
+        return 1;
+    }
+
+    if (config.sizes.empty()) config.sizes = {100, 1000, 5000};
+    if (config.repeat == 0) config.repeat = 1;
+
+    config.mcc = fs::absolute(config.mcc).native();
+    config.generator = fs::absolute(config.generator).native();
+    config.runtimePath = fs::absolute(config.runtimePath).native();
+
+    fs::path work = fs::temp_directory_path() / fs::unique_path("mcc-benchmark-%%%%-%%%%");
+    fs::create_directories(work);
+
+    std::ostringstream json;
+    json << "{\n";
+    bool success = compileBenchmark(config, work, json);
+    if (success && !options.count("skip-runtime")) {
+        json << ",\n";
+        success = runtimeBenchmark(config, work, json);
+    }
+    json << "\n}\n";
+
+    fs::remove_all(work);
+
+    if (!success) return 1;
+
+    if (output.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream(output) << json.str();
+    }
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Measures the scanner alone, tokens and megabytes per second on each of
+ * the given sources. Built once with the compressed tables mcc uses by
+ * default and once with the full ones of FULL_SCANNER_TABLES.
+ *
+ * Usage: lexer-benchmark [-s seconds] file.mc...
+ */
+
+#include "Scanner.hpp"
+#include "MappedFile.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace monicelli;
+
+struct Result {
+    size_t tokens;
+    size_t rounds;
+    double seconds;
+};
+
+static Result scan(MappedFile const& source, double minimum) {
+    Result result = {0, 0, 0};
+    auto start = std::chrono::steady_clock::now();
+
+    do {
+        Scanner scanner(source.getData(), source.getSize());
+        Parser::semantic_type value;
+        Parser::location_type location;
+        while (scanner.yylex(&value, &location) != 0) {
+            ++result.tokens;
+        }
+        ++result.rounds;
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        result.seconds = elapsed.count();
+    } while (result.seconds < minimum);
+
+    return result;
+}
+
+int main(int argc, char **argv) {
+    double minimum = 0.5;
+    int first = 1;
+
+    if (argc > 2 && std::strcmp(argv[1], "-s") == 0) {
+        minimum = std::strtod(argv[2], nullptr);
+        first = 3;
+    }
+
+    if (first >= argc) {
+        std::fprintf(stderr, "Usage: %s [-s seconds] file.mc...\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("tables: %s\n", SCANNER_TABLES);
+    std::printf("%-32s %10s %10s %14s %10s\n", "source", "bytes", "tokens", "tokens/s", "MB/s");
+
+    for (int i = first; i < argc; ++i) {
+        MappedFile source;
+        if (!source.open(argv[i])) {
+            std::fprintf(stderr, "%s: cannot open file\n", argv[i]);
+            return 1;
+        }
+
+        Result result = scan(source, minimum);
+        double bytes = static_cast<double>(source.getSize()) * result.rounds;
+        char const *name = std::strrchr(argv[i], '/');
+
+        std::printf("%-32s %10zu %10zu %14.0f %10.1f\n",
+            name != nullptr? name + 1: argv[i],
+            source.getSize(), result.tokens / result.rounds,
+            result.tokens / result.seconds, bytes / result.seconds / 1e6);
+    }
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares the default and the MONICELLI_FAST_IO runtime by printing and
+ * reading back the same values. Each measure runs in a child process,
+ * since the I/O mode is chosen once per process.
+ *
+ * Usage: runtime-io-benchmark [count]
+ */
+
+#include "Runtime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static void writeValues(long count) {
+    for (long i = 0; i < count; ++i) {
+        __Monicelli_putInt(i * 7919 - count);
+        __Monicelli_putDouble(i / 7.0);
+    }
+}
+
+static void readValues(long count) {
+    Monicelli_Int sum = 0;
+    for (long i = 0; i < count; ++i) {
+        sum += __Monicelli_getInt();
+        sum += (Monicelli_Int) __Monicelli_getDouble();
+    }
+    fprintf(stderr, "%ld\n", (long) sum);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double measure(char const *self, char const *task, long count,
+                      char const *input, char const *output, int fast) {
+    double start = now();
+    pid_t child = fork();
+
+    if (child == 0) {
+        char countString[32];
+        snprintf(countString, sizeof(countString), "%ld", count);
+        setenv("MONICELLI_FAST_IO", fast? "1": "0", 1);
+
+        int in = open(input, O_RDONLY);
+        int out = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int err = open("/dev/null", O_WRONLY);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+
+        execl(self, self, task, countString, (char *) NULL);
+        _exit(1);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    return now() - start;
+}
+
+int main(int argc, char **argv) {
+    long count = argc > 1? atol(argv[1]): 1000000;
+
+    if (argc > 2 && strcmp(argv[1], "write") == 0) {
+        writeValues(atol(argv[2]));
+        return 0;
+    }
+
+    if (argc > 2 && strcmp(argv[1], "read") == 0) {
+        readValues(atol(argv[2]));
+        return 0;
+    }
+
+    char data[] = "/tmp/mcrt-benchmark-XXXXXX";
+    int fd = mkstemp(data);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    /* The default runtime writes the values that are read back later. */
+    measure(argv[0], "write", count, "/dev/null", data, 0);
+
+    printf("%-8s %-8s %12s %12s\n", "task", "mode", "seconds", "ns/value");
+    for (int fast = 0; fast <= 1; ++fast) {
+        double w = measure(argv[0], "write", count, "/dev/null", "/dev/null", fast);
+        double r = measure(argv[0], "read", count, data, "/dev/null", fast);
+        char const *mode = fast? "fast": "default";
+        printf("%-8s %-8s %12.3f %12.1f\n", "write", mode, w, w * 1e9 / (2 * count));
+        printf("%-8s %-8s %12.3f %12.1f\n", "read", mode, r, r * 1e9 / (2 * count));
+    }
+
+    unlink(data);
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Compares Scope and FlatScope on the access pattern of the bitcode
+ * emitter: nested levels declaring a few variables each, and many lookups
+ * of names declared at any of the enclosing levels.
+ *
+ * Usage: scope-benchmark [depth] [rounds]
+ */
+
+#include "Scope.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace monicelli;
+
+static const size_t VARS_PER_LEVEL = 4;
+static const size_t LOOKUPS_PER_LEVEL = 64;
+
+struct Name {
+    std::string value;
+    Symbol symbol;
+};
+
+static std::vector<Name> makeNames(size_t depth) {
+    std::vector<Name> names;
+    for (size_t i = 0; i < depth * VARS_PER_LEVEL; ++i) {
+        std::string value = "variabile_" + std::to_string(i);
+        names.push_back({value, intern(value)});
+    }
+    return names;
+}
+
+template<class S, class Select>
+static size_t run(S &scope, std::vector<Name> const& names, size_t depth, Select key) {
+    size_t checksum = 0;
+
+    for (size_t level = 0; level < depth; ++level) {
+        scope.enter();
+        for (size_t i = 0; i < VARS_PER_LEVEL; ++i) {
+            size_t index = level * VARS_PER_LEVEL + i;
+            scope.push(key(names[index]), index);
+        }
+
+        size_t visible = (level + 1) * VARS_PER_LEVEL;
+        for (size_t i = 0; i < LOOKUPS_PER_LEVEL; ++i) {
+            auto value = scope.lookup(key(names[(i * 7919) % visible]));
+            checksum += value? *value: 0;
+        }
+    }
+
+    for (size_t level = 0; level < depth; ++level) {
+        scope.leave();
+    }
+
+    return checksum;
+}
+
+template<class F>
+static double measure(size_t rounds, size_t &checksum, F body) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+        checksum += body();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Bindings made before any enter() belong to an outermost level.
+static bool checkTopLevel() {
+    FlatScope<size_t> scope;
+    Symbol name = intern("variabile_globale");
+    scope.push(name, 42);
+    scope.enter();
+    scope.leave();
+    auto value = scope.lookup(name);
+    return value && *value == 42;
+}
+
+int main(int argc, char **argv) {
+    if (!checkTopLevel()) {
+        std::fprintf(stderr, "FlatScope lost a binding made before enter()\n");
+        return 1;
+    }
+
+    size_t depth = argc > 1? std::strtoul(argv[1], nullptr, 10): 64;
+    size_t rounds = argc > 2? std::strtoul(argv[2], nullptr, 10): 2000;
+    std::vector<Name> names = makeNames(depth);
+    size_t lookups = depth * LOOKUPS_PER_LEVEL * rounds;
+
+    size_t oldChecksum = 0;
+    Scope<std::string, size_t> oldScope;
+    double oldTime = measure(rounds, oldChecksum, [&]() {
+        return run(oldScope, names, depth, [](Name const& n) { return n.value; });
+    });
+
+    size_t flatChecksum = 0;
+    FlatScope<size_t> flatScope;
+    double flatTime = measure(rounds, flatChecksum, [&]() {
+        return run(flatScope, names, depth, [](Name const& n) { return n.symbol; });
+    });
+
+    if (oldChecksum != flatChecksum) {
+        std::fprintf(stderr, "Scopes disagree: %zu vs %zu\n", oldChecksum, flatChecksum);
+        return 1;
+    }
+
+    std::printf("%-10s %12s %12s\n", "scope", "seconds", "ns/lookup");
+    std::printf("%-10s %12.3f %12.1f\n", "Scope", oldTime, oldTime * 1e9 / lookups);
+    std::printf("%-10s %12.3f %12.1f\n", "FlatScope", flatTime, flatTime * 1e9 / lookups);
+
+    return 0;
+}
@@ -4,6 +4,8 @@ help:
 source:
   - Turtle.cpp
 
+library: turtle.so
+
 functions:
   cofandina:
     args: {x: int, y: int}
@@ -0,0 +1,72 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Arena.hpp"
+
+#include <new>
+
+using namespace monicelli;
+
+static const size_t CHUNK_SIZE = 64 * 1024;
+static const size_t ALIGNMENT = alignof(std::max_align_t);
+
+static thread_local Arena *currentArena = nullptr;
+
+Arena::Arena(): cursor(nullptr), limit(nullptr), allocated(0) {}
+
+Arena::~Arena() {
+    release();
+}
+
+void *Arena::allocate(size_t size) {
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    if (size > static_cast<size_t>(limit - cursor)) {
+        size_t chunkSize = size > CHUNK_SIZE? size: CHUNK_SIZE;
+        char *chunk = static_cast<char*>(::operator new(chunkSize));
+        chunks.push_back(chunk);
+        cursor = chunk;
+        limit = chunk + chunkSize;
+    }
+
+    void *result = cursor;
+    cursor += size;
+    allocated += size;
+    return result;
+}
+
+void Arena::release() {
+    for (char *chunk: chunks) {
+        ::operator delete(chunk);
+    }
+    chunks.clear();
+    cursor = limit = nullptr;
+    allocated = 0;
+}
+
+Arena *Arena::current() {
+    return currentArena;
+}
+
+Arena *Arena::setCurrent(Arena *arena) {
+    Arena *previous = currentArena;
+    currentArena = arena;
+    return previous;
+}
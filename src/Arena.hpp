@@ -0,0 +1,65 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstddef>
+#include <vector>
+
+namespace monicelli {
+
+/**
+ * Bump allocator. Memory handed out is only given back all at once, when
+ * the arena is released or destroyed.
+ */
+class Arena {
+public:
+    Arena();
+    ~Arena();
+
+    Arena(Arena const&) = delete;
+    Arena& operator=(Arena const&) = delete;
+
+    /** Returns size bytes, aligned for any fundamental type. */
+    void *allocate(size_t size);
+
+    void release();
+
+    size_t getAllocatedBytes() const {
+        return allocated;
+    }
+
+    /** Arena that AST nodes created on the current thread go to, if any. */
+    static Arena *current();
+
+    /** Makes arena current for the thread, returns the previous one. */
+    static Arena *setCurrent(Arena *arena);
+
+private:
+    std::vector<char*> chunks;
+    char *cursor;
+    char *limit;
+    size_t allocated;
+};
+
+}
+
+#endif
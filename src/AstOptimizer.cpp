@@ -0,0 +1,335 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "AstOptimizer.hpp"
+
+#include <boost/optional.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+using namespace monicelli;
+
+namespace {
+
+/** Value of a literal, doubles are what Float nodes are emitted as. */
+struct Constant {
+    bool isFloat;
+    int64_t integer;
+    double real;
+
+    double asReal() const {
+        return isFloat? real: static_cast<double>(integer);
+    }
+};
+
+boost::optional<Constant> constantOf(Expression const& expression) {
+    if (Integer const *i = dynamic_cast<Integer const*>(&expression)) {
+        return Constant{false, i->getValue(), 0};
+    }
+    if (Float const *f = dynamic_cast<Float const*>(&expression)) {
+        return Constant{true, 0, f->getValue()};
+    }
+    return boost::none;
+}
+
+/**
+ * Integer arithmetic wraps around like the emitted code. Anything which is
+ * undefined in C++ or differs between the backends is left alone: division
+ * by zero, overflowing division, shifts by 64 or more, and right shifts of
+ * negative values, which are logical in bitcode but not in C++.
+ */
+boost::optional<int64_t> foldInteger(int64_t l, Operator op, int64_t r) {
+    uint64_t ul = l, ur = r;
+
+    switch (op) {
+        case Operator::PLUS:
+            return int64_t(ul + ur);
+        case Operator::MINUS:
+            return int64_t(ul - ur);
+        case Operator::TIMES:
+            return int64_t(ul * ur);
+        case Operator::DIV:
+            if (r == 0 || (l == std::numeric_limits<int64_t>::min() && r == -1)) break;
+            return l / r;
+        case Operator::SHL:
+            if (r < 0 || r >= 64) break;
+            return int64_t(ul << r);
+        case Operator::SHR:
+            if (r < 0 || r >= 64 || l < 0) break;
+            return l >> r;
+        default:
+            break;
+    }
+
+    return boost::none;
+}
+
+boost::optional<double> foldReal(double l, Operator op, double r) {
+    double result;
+
+    switch (op) {
+        case Operator::PLUS:
+            result = l + r;
+            break;
+        case Operator::MINUS:
+            result = l - r;
+            break;
+        case Operator::TIMES:
+            result = l * r;
+            break;
+        case Operator::DIV:
+            result = l / r;
+            break;
+        default:
+            return boost::none;
+    }
+
+    // There is no literal for infinities and NaN, in Monicelli or in C++.
+    if (!std::isfinite(result)) return boost::none;
+    return result;
+}
+
+/**
+ * Truth value of a constant condition. Comparisons are folded only here,
+ * since there is no boolean literal to replace them with, and only when
+ * signed and unsigned comparison agree.
+ */
+boost::optional<bool> truthOf(Expression const& expression) {
+    // Bitcode truncates conditions to one bit, C++ compares them with zero.
+    if (auto value = constantOf(expression)) {
+        if (value->isFloat || (value->integer != 0 && value->integer != 1)) {
+            return boost::none;
+        }
+        return value->integer == 1;
+    }
+
+    BinaryExpression const *binary = dynamic_cast<BinaryExpression const*>(&expression);
+    if (binary == nullptr) return boost::none;
+
+    auto left = constantOf(binary->getLeft());
+    auto right = constantOf(binary->getRight());
+    if (!left || !right) return boost::none;
+
+    double l = left->asReal(), r = right->asReal();
+    if (std::isnan(l) || std::isnan(r)) return boost::none;
+
+    if (!left->isFloat && !right->isFloat) {
+        if (left->integer < 0 || right->integer < 0) return boost::none;
+        if (left->integer != int64_t(l) || right->integer != int64_t(r)) return boost::none;
+    }
+
+    switch (binary->getOperator()) {
+        case Operator::LT:
+            return l < r;
+        case Operator::GT:
+            return l > r;
+        case Operator::LTE:
+            return l <= r;
+        case Operator::GTE:
+            return l >= r;
+        case Operator::EQ:
+            return l == r;
+        default:
+            return boost::none;
+    }
+}
+
+bool sameCondition(SemiExpression const& a, SemiExpression const& b) {
+    if (a.getOperator() != b.getOperator()) return false;
+
+    auto left = constantOf(a.getLeft());
+    auto right = constantOf(b.getLeft());
+    if (!left || !right || left->isFloat != right->isFloat) return false;
+
+    return left->isFloat? left->real == right->real: left->integer == right->integer;
+}
+
+/** Whether nothing after this statement, in the same block, can run. */
+bool endsBlock(Statement const& statement) {
+    if (dynamic_cast<Return const*>(&statement) != nullptr) return true;
+    if (dynamic_cast<Abort const*>(&statement) != nullptr) return true;
+
+    // A loop can only be left through its condition.
+    Loop const *loop = dynamic_cast<Loop const*>(&statement);
+    if (loop != nullptr) {
+        auto always = truthOf(loop->getCondition());
+        return always && *always;
+    }
+
+    return false;
+}
+
+bool declaresVariables(PointerList<Statement> const& statements) {
+    for (Statement const& statement: statements) {
+        if (dynamic_cast<VarDeclaration const*>(&statement) != nullptr) return true;
+    }
+    return false;
+}
+
+}
+
+void AstOptimizer::optimize(Program &program) {
+    for (Function &function: program.functions) {
+        optimize(function);
+    }
+
+    if (program.main) {
+        optimize(*program.main);
+    }
+}
+
+void AstOptimizer::optimize(Function &function) {
+    optimize(*function.body);
+}
+
+void AstOptimizer::optimize(PointerList<Statement> &statements) {
+    for (size_t i = 0; i < statements.size(); ++i) {
+        optimize(statements[i]);
+
+        Loop *loop = dynamic_cast<Loop*>(&statements[i]);
+        if (loop != nullptr) {
+            auto always = truthOf(*loop->condition);
+
+            // Loops test their condition after the body, so this runs once.
+            // Declarations would move to the outer scope, keep those.
+            if (always && !*always && !declaresVariables(*loop->body)) {
+                PointerList<Statement> body;
+                body.transfer(body.end(), *loop->body);
+                statements.erase(statements.begin() + i);
+                statements.transfer(statements.begin() + i, body);
+                --i;
+                continue;
+            }
+        }
+
+        Assert *check = dynamic_cast<Assert*>(&statements[i]);
+        if (check != nullptr) {
+            auto always = truthOf(*check->expression);
+            if (always && *always) {
+                statements.erase(statements.begin() + i);
+                --i;
+                continue;
+            }
+        }
+
+        if (endsBlock(statements[i])) {
+            statements.erase(statements.begin() + i + 1, statements.end());
+        }
+    }
+}
+
+void AstOptimizer::optimize(Statement &statement) {
+    if (Return *node = dynamic_cast<Return*>(&statement)) {
+        if (node->expression) fold(node->expression);
+    } else if (Loop *node = dynamic_cast<Loop*>(&statement)) {
+        optimize(*node->body);
+        fold(node->condition);
+    } else if (VarDeclaration *node = dynamic_cast<VarDeclaration*>(&statement)) {
+        if (node->init) fold(node->init);
+    } else if (Assignment *node = dynamic_cast<Assignment*>(&statement)) {
+        fold(node->value);
+    } else if (Print *node = dynamic_cast<Print*>(&statement)) {
+        fold(node->expression);
+    } else if (Assert *node = dynamic_cast<Assert*>(&statement)) {
+        fold(node->expression);
+    } else if (FunctionCall *node = dynamic_cast<FunctionCall*>(&statement)) {
+        fold(*node->args);
+    } else if (Branch *node = dynamic_cast<Branch*>(&statement)) {
+        optimize(*node);
+    }
+}
+
+void AstOptimizer::optimize(Branch &branch) {
+    PointerList<BranchCase> &cases = *branch.body->cases;
+
+    for (BranchCase &branchCase: cases) {
+        fold(branchCase.condition->left);
+        optimize(*branchCase.body);
+    }
+
+    // Cases are tried in order, a repeated condition never matches.
+    for (size_t i = 1; i < cases.size(); ++i) {
+        bool shadowed = false;
+        for (size_t j = 0; j < i && !shadowed; ++j) {
+            shadowed = sameCondition(*cases[j].condition, *cases[i].condition);
+        }
+
+        if (shadowed) {
+            cases.erase(cases.begin() + i);
+            --i;
+        }
+    }
+
+    if (branch.body->els) {
+        optimize(*branch.body->els);
+    }
+}
+
+void AstOptimizer::fold(Pointer<Expression> &expression) {
+    Expression *simpler = simplify(*expression);
+    if (simpler != nullptr) {
+        expression.reset(simpler);
+    }
+}
+
+void AstOptimizer::fold(PointerList<Expression> &expressions) {
+    for (size_t i = 0; i < expressions.size(); ++i) {
+        Expression *simpler = simplify(expressions[i]);
+        if (simpler != nullptr) {
+            expressions.replace(i, simpler);
+        }
+    }
+}
+
+/** Returns a replacement for expression, or nullptr to keep it. */
+Expression *AstOptimizer::simplify(Expression &expression) {
+    if (FunctionCall *call = dynamic_cast<FunctionCall*>(&expression)) {
+        fold(*call->args);
+        return nullptr;
+    }
+
+    BinaryExpression *binary = dynamic_cast<BinaryExpression*>(&expression);
+    if (binary == nullptr) return nullptr;
+
+    fold(binary->left);
+    fold(binary->right);
+
+    auto left = constantOf(*binary->left);
+    auto right = constantOf(*binary->right);
+    if (!left || !right) return nullptr;
+
+    Expression *result = nullptr;
+
+    if (left->isFloat || right->isFloat) {
+        auto value = foldReal(left->asReal(), binary->op, right->asReal());
+        if (value) result = new Float(*value);
+    } else {
+        auto value = foldInteger(left->integer, binary->op, right->integer);
+        if (value) result = new Integer(*value);
+    }
+
+    if (result != nullptr) {
+        result->setLocation(expression.getSourceLocation());
+    }
+
+    return result;
+}
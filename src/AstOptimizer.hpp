@@ -0,0 +1,51 @@
+#ifndef AST_OPTIMIZER_HPP
+#define AST_OPTIMIZER_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Nodes.hpp"
+
+namespace monicelli {
+
+/**
+ * Simplifies a parsed program in place before it reaches any emitter.
+ * Only rewrites on which all backends agree are done: arithmetic on
+ * literals, cases shadowed by an identical earlier one, loops which run
+ * once, and statements which can never run.
+ */
+class AstOptimizer {
+public:
+    void optimize(Program &program);
+    void optimize(Function &function);
+
+private:
+    void optimize(PointerList<Statement> &statements);
+    void optimize(Statement &statement);
+    void optimize(Branch &branch);
+
+    void fold(Pointer<Expression> &expression);
+    void fold(PointerList<Expression> &expressions);
+    Expression *simplify(Expression &expression);
+};
+
+}
+
+#endif
@@ -21,43 +21,284 @@
 #include "Scope.hpp"
 #include "Nodes.hpp"
 #include "ModuleRegistry.hpp"
+#include "Diagnostics.hpp"
+#include "CLineParser.hpp"
+#include "TimeReport.hpp"
+#include "Memoization.hpp"
 
 #include <llvm/IR/Verifier.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/ValueHandle.h>
 #include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/DIBuilder.h>
+#include <llvm/IR/DebugInfoMetadata.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Linker/Linker.h>
 #include <llvm/Transforms/Scalar.h>
-#include <llvm/Analysis/Passes.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
+#include <llvm/Analysis/BasicAliasAnalysis.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/Dwarf.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
 
 #include <cassert>
+#include <chrono>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <string>
 #include <map>
 #include <vector>
 #include <unordered_set>
 #include <initializer_list>
 #include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <atomic>
+#include <functional>
+#include <thread>
 
 // Yes, that's right, no ending ;
 #define GUARDED(call) if (!(call)) return false
 
 
 using namespace monicelli;
-using llvm::getGlobalContext;
 
 
+typedef std::unordered_map<std::string, uint64_t> Profile;
+
+struct SelfCall {
+    llvm::WeakVH call;
+    unsigned line;
+    unsigned column;
+};
+
 struct BitcodeEmitter::Private {
+    Private(llvm::LLVMContext &context): context(context), builder(context) {}
+
     llvm::Value *retval = nullptr;
     llvm::AllocaInst *funcRetval = nullptr;
     llvm::BasicBlock *funcExit = nullptr;
 
-    llvm::IRBuilder<> builder = llvm::IRBuilder<>(getGlobalContext());
-    Scope<std::string, llvm::AllocaInst*> scope;
+    llvm::LLVMContext &context;
+    llvm::IRBuilder<> builder;
+    FlatScope<llvm::AllocaInst*> scope;
     Pointer<llvm::legacy::FunctionPassManager> optimizer;
+    Pointer<llvm::legacy::PassManager> moduleOptimizer;
+    Pointer<llvm::TargetMachine> target;
+
+    // CPU and features from --march, --mcpu and --mattr, if given.
+    std::string triple;
+    std::string cpu;
+    std::string features;
+    unsigned level = 1;
+    bool optimize = false;
+
+    // What --assert makes of assertions: a cheap inline check, a hint
+    // for the optimizer, or nothing at all.
+    enum class Asserts { CHECK, ASSUME, OFF } asserts = Asserts::CHECK;
+
+    // Functions whose results are cached with --memoize, in tables of
+    // 2^memoBits entries each.
+    std::unordered_set<Symbol> memoized;
+    unsigned memoBits = 12;
+
+    // With --threads, functions are optimized and compiled in partitions,
+    // on this many threads, after the whole module has been emitted.
+    unsigned threads = 0;
+
+    // Profile keys start with the name of the function being emitted, and
+    // count lines from the line of its prototype.
+    std::string function;
+    unsigned functionLine = 0;
+    bool instrument = false;
+    std::vector<std::pair<std::string, llvm::GlobalVariable*>> counters;
+    Profile const* profile = nullptr;
+
+    // Calls of the function being emitted to itself, for --report-recursion.
+    std::vector<SelfCall> selfCalls;
+
+    // Sites of the --profile report, for functions and loops.
+    bool profiler = false;
+    bool profileLoops = false;
+    std::vector<llvm::GlobalVariable*> sites;
+    llvm::GlobalVariable *functionSite = nullptr;
+
+    // Debug information, only with -g.
+    Pointer<llvm::DIBuilder> debug;
+    llvm::DICompileUnit *debugUnit = nullptr;
+    llvm::DIFile *debugFile = nullptr;
+    llvm::DISubprogram *debugScope = nullptr;
+    std::map<Type, llvm::DIType*> debugTypes;
 };
 
+static std::once_flag targetsInitialized;
+
+static
+void initializeTargets() {
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
+}
+
+static
+llvm::CodeGenOpt::Level codegenLevel(unsigned level) {
+    switch (level) {
+        case 0:
+            return llvm::CodeGenOpt::None;
+        case 1:
+            return llvm::CodeGenOpt::Less;
+        case 2:
+            return llvm::CodeGenOpt::Default;
+        default:
+            return llvm::CodeGenOpt::Aggressive;
+    }
+}
+
+static
+std::string hostFeatures() {
+    llvm::StringMap<bool> features;
+    if (!llvm::sys::getHostCPUFeatures(features)) return "";
+
+    std::string result;
+    for (auto const& feature: features) {
+        if (!result.empty()) result += ',';
+        result += (feature.getValue()? '+': '-') + feature.getKey().str();
+    }
+    return result;
+}
+
+/**
+ * Applies --march, --mcpu and --mattr to the triple, and works out the CPU
+ * and its features. Either can be native, meaning the host CPU; --march
+ * native also targets the host.
+ */
+static
+void selectTarget(std::string &triple, std::string &cpu, std::string &features) {
+    if (configHas("march")) {
+        std::string arch = config<std::string>("march");
+
+        if (arch == "native") {
+            triple = llvm::sys::getProcessTriple();
+            cpu = llvm::sys::getHostCPUName().str();
+            features = hostFeatures();
+        } else {
+            llvm::Triple parsed(triple);
+            parsed.setArchName(arch);
+            triple = parsed.str();
+        }
+    }
+
+    if (configHas("mcpu")) {
+        cpu = config<std::string>("mcpu");
+
+        if (cpu == "native") {
+            cpu = llvm::sys::getHostCPUName().str();
+            features = hostFeatures();
+        }
+    }
+
+    if (configHas("mattr")) {
+        std::string extra = config<std::string>("mattr");
+        features = features.empty()? extra: features + ',' + extra;
+    }
+}
+
+static
+llvm::TargetMachine* createTargetMachine(std::string const& triple, std::string const& cpu,
+                                         std::string const& features, unsigned level) {
+    std::call_once(targetsInitialized, initializeTargets);
+
+    std::string error;
+    llvm::Target const* target = llvm::TargetRegistry::lookupTarget(triple, error);
+
+    if (target == nullptr) {
+        diagnostics() << "Cannot generate code for " << triple << ": " << error << std::endl;
+        return nullptr;
+    }
+
+    llvm::TargetOptions options;
+
+    if (configHas("fast-math")) {
+        options.UnsafeFPMath = true;
+        options.NoInfsFPMath = true;
+        options.NoNaNsFPMath = true;
+    }
+
+    return target->createTargetMachine(
+        triple, cpu, features, options, llvm::Reloc::PIC_,
+        llvm::CodeModel::Default, codegenLevel(level)
+    );
+}
+
+static
+void configureOptimizer(llvm::PassManagerBuilder &builder, std::string const& triple, unsigned level) {
+    builder.OptLevel = level;
+    builder.SizeLevel = 0;
+    builder.LibraryInfo = new llvm::TargetLibraryInfoImpl(llvm::Triple(triple));
+    builder.LoopVectorize = level > 1;
+    builder.SLPVectorize = level > 1;
+
+    if (level > 0) {
+        builder.Inliner = llvm::createFunctionInliningPass(level, 0);
+    }
+}
+
+/**
+ * Passes run on every function once emitted: those of builder with -O,
+ * or else a few cheap ones, which keep the bitcode readable when
+ * disassembled.
+ */
+static
+void populateFunctionOptimizer(llvm::legacy::FunctionPassManager &optimizer,
+                               llvm::TargetMachine *target, llvm::PassManagerBuilder *builder) {
+    if (builder == nullptr) {
+        optimizer.add(llvm::createBasicAAWrapperPass());
+        optimizer.add(llvm::createInstructionCombiningPass());
+        optimizer.add(llvm::createReassociatePass());
+        optimizer.add(llvm::createGVNPass());
+        optimizer.add(llvm::createTailCallEliminationPass());
+        optimizer.add(llvm::createCFGSimplificationPass());
+        optimizer.doInitialization();
+        return;
+    }
+
+    if (target != nullptr) {
+        optimizer.add(llvm::createTargetTransformInfoWrapperPass(target->getTargetIRAnalysis()));
+    }
+
+    builder->populateFunctionPassManager(optimizer);
+
+    // Self recursion becomes a loop before inlining, which also makes
+    // --report-recursion accurate for each function on its own.
+    optimizer.add(llvm::createTailCallEliminationPass());
+
+    optimizer.doInitialization();
+}
+
 static
 llvm::AllocaInst* allocateVar(llvm::Function *func, Id const& name, llvm::Type *type) {
     llvm::IRBuilder<> builder(&func->getEntryBlock(), func->getEntryBlock().begin());
@@ -72,66 +313,34 @@ llvm::AllocaInst* allocateReturnVariable(llvm::Function *func) {
 
 static
 bool reportError(Localizable const& node, std::initializer_list<std::string> const& what) {
-    std::cerr << "line " << node.getLocation().begin.line << ", ";
-    std::cerr << "col " << node.getLocation().begin.column << ": ";
+    std::ostream &out = diagnostics();
+
+    out << "line " << node.getLocation().begin.line << ", ";
+    out << "col " << node.getLocation().begin.column << ": ";
 
     for (std::string const& chunk: what) {
-        std::cerr << chunk << ' ';
+        out << chunk << ' ';
     }
-    std::cerr << std::endl;
+    out << std::endl;
 
     return false;
 }
 
-#define I64 llvm::Type::getInt64Ty(getGlobalContext())
-#define  I8 llvm::Type::getInt8Ty(getGlobalContext())
-#define  I1 llvm::Type::getInt1Ty(getGlobalContext())
-#define   F llvm::Type::getFloatTy(getGlobalContext())
-#define   D llvm::Type::getDoubleTy(getGlobalContext())
-#define   V llvm::Type::getVoidTy(getGlobalContext())
-
-static const std::unordered_map<llvm::Type*, std::unordered_map<llvm::Type*, llvm::Type*>> TYPECAST_MAP = {
-    {I64, {            {I8, I64}, {I1, I64}, { F, D}, {D, D}}},
-    { I8, {{I64, I64},            {I1,  I8}, { F, F}, {D, D}}},
-    { I1, {{I64, I64}, {I8,  I8},            { F, F}, {D, D}}},
-    {  F, {{I64,   D}, {I8,   F}, {I1,   F},          {D, D}}},
-    {  D, {{I64,   D}, {I8,   D}, {I1,   D}, { F, D}        }}
-};
-
 static
-Type MonicelliType(llvm::Type const* type) {
-    if (type == I64) {
-        return Type::INT;
-    } else if (type == I8) {
-        return Type::CHAR;
-    } else if (type == I1) {
-        return Type::BOOL;
-    } else if (type == D) {
-        return Type::DOUBLE;
-    } else if (type == F) {
-        return Type::FLOAT;
-    } else if (type == V) {
-        return Type::VOID;
-    }
-
-    return Type::UNKNOWN;
-}
-
-static
-llvm::Type *LLVMType(Type const& type) {
+llvm::Type *LLVMType(Type const& type, llvm::LLVMContext &context) {
     switch (type) {
         case Type::INT:
-            return I64;
+            return llvm::Type::getInt64Ty(context);
         case Type::CHAR:
-            return I8;
+            return llvm::Type::getInt8Ty(context);
         case Type::FLOAT:
-            return F;
+            return llvm::Type::getFloatTy(context);
         case Type::BOOL:
-            return I1;
+            return llvm::Type::getInt1Ty(context);
         case Type::DOUBLE:
-            return D;
+            return llvm::Type::getDoubleTy(context);
         case Type::VOID:
-            return V;
+            return llvm::Type::getVoidTy(context);
         case Type::UNKNOWN:
             return nullptr; // FIXME
     }
@@ -139,29 +348,6 @@ llvm::Type *LLVMType(Type const& type) {
     return nullptr;
 }
 
-static
-llvm::Type* deduceResultType(llvm::Value *left, llvm::Value *right) {
-    llvm::Type *lt = left->getType();
-    llvm::Type *rt = right->getType();
-
-    if (lt == rt) return rt;
-
-    auto subTable = TYPECAST_MAP.find(lt);
-    if (subTable != TYPECAST_MAP.end()) {
-        auto resultType = subTable->second.find(rt);
-        if (resultType != subTable->second.end()) return resultType->second;
-    }
-
-    return nullptr;
-}
-
-#undef I64
-#undef  I8
-#undef  I1
-#undef   F
-#undef   D
-#undef   V
-
 static inline
 bool isFP(llvm::Type *type) {
     return type->isFloatTy() || type->isDoubleTy();
@@ -200,30 +386,426 @@ llvm::Value* coerce(BitcodeEmitter::Private *d, llvm::Value *val, llvm::Type *to
 
 static
 llvm::Value* isTrue(BitcodeEmitter::Private *d, llvm::Value* test, llvm::Twine const& label="") {
-    llvm::Value *one = llvm::ConstantInt::get(getGlobalContext(), llvm::APInt(1, 0));
+    llvm::Value *one = llvm::ConstantInt::get(d->context, llvm::APInt(1, 0));
     return d->builder.CreateICmpNE(
         coerce(d, test, one->getType()), one, label
     );
 }
 
-static const std::map<Type, std::string> PUT_NAMES = {{
-    {Type::BOOL, "__Monicelli_putBool"},
-    {Type::CHAR, "__Monicelli_putChar"},
-    {Type::FLOAT, "__Monicelli_putFloat"},
-    {Type::DOUBLE, "__Monicelli_putDouble"},
-    {Type::INT, "__Monicelli_putInt"}
-}};
+static const std::string ABORT_NAME = "__Monicelli_abort";
+static const std::string ASSERT_NAME = "__Monicelli_assert";
+static const std::string PROFILE_INIT_NAME = "__Monicelli_profileInit";
+static const std::string PROFILE_WRITE_NAME = "__Monicelli_profileWrite";
+
+/**
+ * Gives the instructions emitted for a node its line and column, until
+ * the end of the scope, when the location of the parent is restored.
+ */
+class DebugLocation {
+public:
+    DebugLocation(BitcodeEmitter::Private *d, Localizable const& node):
+        d(d), previous(d->builder.getCurrentDebugLocation()) {
+        if (d->debugScope != nullptr && node.getLocation().begin.line > 0) {
+            d->builder.SetCurrentDebugLocation(llvm::DebugLoc::get(
+                node.getLocation().begin.line, node.getLocation().begin.column, d->debugScope
+            ));
+        }
+    }
+
+    ~DebugLocation() {
+        d->builder.SetCurrentDebugLocation(previous);
+    }
 
-static const std::map<Type, std::string> GET_NAMES = {
-    {Type::BOOL, "__Monicelli_getBool"},
-    {Type::CHAR, "__Monicelli_getChar"},
-    {Type::FLOAT, "__Monicelli_getFloat"},
-    {Type::DOUBLE, "__Monicelli_getDouble"},
-    {Type::INT, "__Monicelli_getInt"}
+private:
+    BitcodeEmitter::Private *d;
+    llvm::DebugLoc previous;
 };
 
-static const std::string ABORT_NAME = "__Monicelli_abort";
-static const std::string ASSERT_NAME = "__Monicelli_assert";
+static
+void startDebugInfo(BitcodeEmitter::Private *d, llvm::Module &module, std::string const& source) {
+    llvm::SmallString<128> directory;
+    llvm::sys::fs::current_path(directory);
+
+    module.addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+    module.addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+
+    d->debug = Pointer<llvm::DIBuilder>(new llvm::DIBuilder(module));
+    d->debugFile = d->debug->createFile(source, directory);
+    d->debugUnit = d->debug->createCompileUnit(
+        llvm::dwarf::DW_LANG_C, source, directory, "mcc", configHas("optimize"), "", 0
+    );
+}
+
+static
+llvm::DIType* debugType(BitcodeEmitter::Private *d, Type type) {
+    auto found = d->debugTypes.find(type);
+    if (found != d->debugTypes.end()) return found->second;
+
+    std::ostringstream name;
+    name << type;
+
+    llvm::DIType *result = nullptr;
+    switch (type) {
+        case Type::INT:
+            result = d->debug->createBasicType(name.str(), 64, 64, llvm::dwarf::DW_ATE_signed);
+            break;
+        case Type::CHAR:
+            result = d->debug->createBasicType(name.str(), 8, 8, llvm::dwarf::DW_ATE_signed_char);
+            break;
+        case Type::BOOL:
+            result = d->debug->createBasicType(name.str(), 8, 8, llvm::dwarf::DW_ATE_boolean);
+            break;
+        case Type::FLOAT:
+            result = d->debug->createBasicType(name.str(), 32, 32, llvm::dwarf::DW_ATE_float);
+            break;
+        case Type::DOUBLE:
+            result = d->debug->createBasicType(name.str(), 64, 64, llvm::dwarf::DW_ATE_float);
+            break;
+        case Type::VOID:
+        case Type::UNKNOWN:
+            break;
+    }
+
+    d->debugTypes[type] = result;
+    return result;
+}
+
+static
+void startDebugFunction(BitcodeEmitter::Private *d, Function const& node, llvm::Function *func) {
+    if (!d->debug) return;
+
+    FunctionPrototype const& proto = node.getPrototype();
+    std::vector<llvm::Metadata*> types = {debugType(d, proto.getType())};
+    for (FunArg const& arg: proto.getArgs()) {
+        types.push_back(debugType(d, arg.getType()));
+    }
+
+    unsigned line = node.getLocation().begin.line;
+    d->debugScope = d->debug->createFunction(
+        d->debugUnit, func->getName(), func->getName(), d->debugFile, line,
+        d->debug->createSubroutineType(d->debug->getOrCreateTypeArray(types)),
+        false, true, line, llvm::DINode::FlagPrototyped, configHas("optimize")
+    );
+    func->setSubprogram(d->debugScope);
+
+    d->builder.SetCurrentDebugLocation(llvm::DebugLoc::get(line, 0, d->debugScope));
+}
+
+static
+void endDebugFunction(BitcodeEmitter::Private *d) {
+    d->debugScope = nullptr;
+    d->builder.SetCurrentDebugLocation(llvm::DebugLoc());
+}
+
+/**
+ * Describes a variable by its stack slot. Promotion to registers turns
+ * the declaration into values, so the variable can still be followed.
+ * Arguments are numbered from 1, local variables have argument 0.
+ */
+static
+void declareVariable(BitcodeEmitter::Private *d, llvm::AllocaInst *alloc, Id const& name,
+                     Type type, Localizable const& node, unsigned argument) {
+    if (!d->debug) return;
+
+    unsigned line = node.getLocation().begin.line;
+    llvm::DILocalVariable *variable = argument > 0?
+        d->debug->createParameterVariable(
+            d->debugScope, name.getValue(), argument, d->debugFile, line, debugType(d, type), true
+        ):
+        d->debug->createAutoVariable(
+            d->debugScope, name.getValue(), d->debugFile, line, debugType(d, type), true
+        );
+
+    d->debug->insertDeclare(
+        alloc, variable, d->debug->createExpression(),
+        llvm::DebugLoc::get(line, node.getLocation().begin.column, d->debugScope),
+        d->builder.GetInsertBlock()
+    );
+}
+
+/**
+ * Code added to main after it was emitted is attributed to its first line.
+ */
+static
+void setMainLocation(BitcodeEmitter::Private *d, llvm::Function *main) {
+    llvm::DISubprogram *scope = main->getSubprogram();
+    d->builder.SetCurrentDebugLocation(
+        scope? llvm::DebugLoc::get(scope->getLine(), 0, scope): llvm::DebugLoc()
+    );
+}
+
+/**
+ * Profiles are shared by all the jobs of a run and only read once. Counts
+ * of a key found more than once add up, so profiles of several runs can
+ * simply be concatenated.
+ */
+static
+Profile const* loadProfile(std::string const& path) {
+    static std::mutex mutex;
+    static std::map<std::string, Pointer<Profile>> loaded;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto found = loaded.find(path);
+    if (found != loaded.end()) return found->second.get();
+
+    Pointer<Profile> profile;
+    std::ifstream stream(path);
+
+    if (stream.good()) {
+        profile.reset(new Profile());
+        std::string key;
+        uint64_t count;
+        while (stream >> key >> count) {
+            (*profile)[key] += count;
+        }
+    } else {
+        diagnostics() << "Cannot read profile " << path << ", ignoring it" << std::endl;
+    }
+
+    Profile const* result = profile.get();
+    loaded[path] = std::move(profile);
+    return result;
+}
+
+// Keys do not depend on the position of the function in the file, lines
+// are counted from its prototype, so a profile survives edits elsewhere.
+static
+std::string profileKey(BitcodeEmitter::Private *d, Localizable const& node, std::string const& what) {
+    Position where = node.getLocation().begin;
+    return d->function + ':' +
+        std::to_string(where.line - d->functionLine) + ':' +
+        std::to_string(where.column) + ':' + what;
+}
+
+static
+uint64_t profileCount(BitcodeEmitter::Private *d, std::string const& key) {
+    auto found = d->profile->find(key);
+    return found != d->profile->end()? found->second: 0;
+}
+
+static
+void incrementCounter(BitcodeEmitter::Private *d, std::string const& key, llvm::Value *amount) {
+    llvm::Module *module = d->builder.GetInsertBlock()->getParent()->getParent();
+    llvm::Type *type = llvm::Type::getInt64Ty(d->context);
+
+    llvm::GlobalVariable *counter = new llvm::GlobalVariable(
+        *module, type, false, llvm::GlobalValue::InternalLinkage,
+        llvm::ConstantInt::get(type, 0), "profc"
+    );
+    d->counters.emplace_back(key, counter);
+
+    llvm::Value *count = d->builder.CreateLoad(counter);
+    d->builder.CreateStore(d->builder.CreateAdd(count, amount), counter);
+}
+
+static
+void countBlock(BitcodeEmitter::Private *d, std::string const& key) {
+    if (d->instrument) {
+        incrementCounter(d, key, llvm::ConstantInt::get(llvm::Type::getInt64Ty(d->context), 1));
+    }
+}
+
+/**
+ * Branch weights are 32 bits wide, larger counts are scaled down together.
+ * Code which never ran gets no weights at all.
+ */
+static
+llvm::MDNode* branchWeights(BitcodeEmitter::Private *d, std::vector<uint64_t> const& counts) {
+    uint64_t largest = *std::max_element(counts.begin(), counts.end());
+    if (largest == 0) return nullptr;
+
+    uint64_t scale = largest / std::numeric_limits<uint32_t>::max() + 1;
+
+    std::vector<uint32_t> weights;
+    for (uint64_t count: counts) {
+        weights.push_back(static_cast<uint32_t>(count / scale));
+    }
+
+    return llvm::MDBuilder(d->context).createBranchWeights(weights);
+}
+
+/**
+ * Conditional branch, counted with --profile-generate and weighted with
+ * the counts of --profile-use.
+ */
+static
+void createProfiledBr(BitcodeEmitter::Private *d, Localizable const& node, std::string const& what,
+                      llvm::Value *condition, llvm::BasicBlock *taken, llvm::BasicBlock *notTaken) {
+    if (d->instrument) {
+        std::string key = profileKey(d, node, what);
+        llvm::Type *type = llvm::Type::getInt64Ty(d->context);
+        incrementCounter(d, key + ":true", d->builder.CreateZExt(condition, type));
+        incrementCounter(d, key + ":false", d->builder.CreateZExt(d->builder.CreateNot(condition), type));
+    }
+
+    llvm::BranchInst *branch = d->builder.CreateCondBr(condition, taken, notTaken);
+
+    if (d->profile) {
+        std::string key = profileKey(d, node, what);
+        llvm::MDNode *weights = branchWeights(d, {
+            profileCount(d, key + ":true"), profileCount(d, key + ":false")
+        });
+        if (weights) branch->setMetadata(llvm::LLVMContext::MD_prof, weights);
+    }
+}
+
+/**
+ * Makes main hand the counters over to the runtime when it starts, and
+ * write them out before returning.
+ */
+static
+void emitProfileRegistration(BitcodeEmitter::Private *d, llvm::Module &module) {
+    llvm::Function *main = module.getFunction("main");
+    if (!d->instrument || main == nullptr || main->empty()) return;
+
+    llvm::BasicBlock &entry = main->getEntryBlock();
+    d->builder.SetInsertPoint(&entry, entry.getFirstInsertionPt());
+    setMainLocation(d, main);
+
+    llvm::Type *voidType = llvm::Type::getVoidTy(d->context);
+    llvm::Type *sizeType = llvm::Type::getInt64Ty(d->context);
+    llvm::Type *keyType = llvm::Type::getInt8PtrTy(d->context);
+    llvm::StructType *entryType = llvm::StructType::get(d->context, {
+        keyType, llvm::Type::getInt64PtrTy(d->context)
+    });
+
+    std::vector<llvm::Constant*> entries;
+    for (auto const& counter: d->counters) {
+        llvm::Value *key = d->builder.CreateGlobalStringPtr(counter.first, "profkey");
+        entries.push_back(llvm::ConstantStruct::get(entryType, {
+            llvm::cast<llvm::Constant>(key), counter.second
+        }));
+    }
+
+    llvm::ArrayType *tableType = llvm::ArrayType::get(entryType, entries.size());
+    llvm::GlobalVariable *table = new llvm::GlobalVariable(
+        module, tableType, true, llvm::GlobalValue::InternalLinkage,
+        llvm::ConstantArray::get(tableType, entries), "profcounters"
+    );
+
+    llvm::Constant *init = module.getOrInsertFunction(PROFILE_INIT_NAME, llvm::FunctionType::get(
+        voidType, {keyType, entryType->getPointerTo(), sizeType}, false
+    ));
+    d->builder.CreateCall(init, {
+        d->builder.CreateGlobalStringPtr(config<std::string>("profile-generate"), "profpath"),
+        d->builder.CreateConstGEP2_32(tableType, table, 0, 0),
+        llvm::ConstantInt::get(sizeType, entries.size())
+    });
+
+    llvm::Constant *write = module.getOrInsertFunction(
+        PROFILE_WRITE_NAME, llvm::FunctionType::get(voidType, false)
+    );
+    for (llvm::BasicBlock &bb: *main) {
+        if (llvm::isa<llvm::ReturnInst>(bb.getTerminator())) {
+            // A musttail call may only be followed by its return.
+            auto call = llvm::dyn_cast_or_null<llvm::CallInst>(bb.getTerminator()->getPrevNode());
+            if (call != nullptr && call->isMustTailCall()) {
+                call->setTailCallKind(llvm::CallInst::TCK_Tail);
+            }
+            d->builder.SetInsertPoint(bb.getTerminator());
+            d->builder.CreateCall(write);
+        }
+    }
+}
+
+static const std::string PROFILER_START_NAME = "__Monicelli_profilerStart";
+static const std::string PROFILER_ENTER_NAME = "__Monicelli_profilerEnter";
+static const std::string PROFILER_EXIT_NAME = "__Monicelli_profilerExit";
+static const std::string PROFILER_REPORT_NAME = "__Monicelli_profilerReport";
+
+// Field of Monicelli_ProfilerSite incremented by loop iterations.
+static const unsigned PROFILER_COUNT_FIELD = 4;
+
+static
+llvm::StructType* profilerSiteType(llvm::LLVMContext &context) {
+    llvm::Type *integer = llvm::Type::getInt64Ty(context);
+    return llvm::StructType::get(context, {
+        llvm::Type::getInt8PtrTy(context),
+        integer, integer, integer, integer, integer, integer, integer
+    });
+}
+
+static
+llvm::GlobalVariable* createProfilerSite(BitcodeEmitter::Private *d, Localizable const& node, bool loop) {
+    llvm::Module *module = d->builder.GetInsertBlock()->getParent()->getParent();
+    llvm::Type *integer = llvm::Type::getInt64Ty(d->context);
+    llvm::StructType *type = profilerSiteType(d->context);
+
+    auto value = [integer](uint64_t value) {
+        return llvm::ConstantInt::get(integer, value);
+    };
+
+    llvm::Constant *name = llvm::cast<llvm::Constant>(
+        d->builder.CreateGlobalStringPtr(d->function, "sitename")
+    );
+
+    llvm::GlobalVariable *site = new llvm::GlobalVariable(
+        *module, type, false, llvm::GlobalValue::InternalLinkage,
+        llvm::ConstantStruct::get(type, {
+            name, value(node.getLocation().begin.line), value(node.getLocation().begin.column),
+            value(loop), value(0), value(0), value(0), value(0)
+        }),
+        "profsite"
+    );
+    d->sites.push_back(site);
+
+    return site;
+}
+
+static
+void callProfiler(BitcodeEmitter::Private *d, std::string const& name, llvm::GlobalVariable *site) {
+    llvm::Module *module = d->builder.GetInsertBlock()->getParent()->getParent();
+    llvm::Constant *callee = module->getOrInsertFunction(name, llvm::FunctionType::get(
+        llvm::Type::getVoidTy(d->context), {site->getType()}, false
+    ));
+    d->builder.CreateCall(callee, {site});
+}
+
+/**
+ * Makes main start the profiler with the table of all sites, and print the
+ * report before returning.
+ */
+static
+void emitProfilerRegistration(BitcodeEmitter::Private *d, llvm::Module &module) {
+    llvm::Function *main = module.getFunction("main");
+    if (d->sites.empty() || main == nullptr || main->empty()) return;
+
+    llvm::BasicBlock &entry = main->getEntryBlock();
+    d->builder.SetInsertPoint(&entry, entry.getFirstInsertionPt());
+    setMainLocation(d, main);
+
+    llvm::Type *voidType = llvm::Type::getVoidTy(d->context);
+    llvm::Type *sizeType = llvm::Type::getInt64Ty(d->context);
+    llvm::Type *pathType = llvm::Type::getInt8PtrTy(d->context);
+    llvm::PointerType *siteType = profilerSiteType(d->context)->getPointerTo();
+
+    std::vector<llvm::Constant*> sites(d->sites.begin(), d->sites.end());
+    llvm::ArrayType *tableType = llvm::ArrayType::get(siteType, sites.size());
+    llvm::GlobalVariable *table = new llvm::GlobalVariable(
+        module, tableType, true, llvm::GlobalValue::InternalLinkage,
+        llvm::ConstantArray::get(tableType, sites), "profsites"
+    );
+
+    llvm::Constant *start = module.getOrInsertFunction(PROFILER_START_NAME, llvm::FunctionType::get(
+        voidType, {pathType, siteType->getPointerTo(), sizeType}, false
+    ));
+    d->builder.CreateCall(start, {
+        d->builder.CreateGlobalStringPtr(config<std::string>("profile"), "profreport"),
+        d->builder.CreateConstGEP2_32(tableType, table, 0, 0),
+        llvm::ConstantInt::get(sizeType, sites.size())
+    });
+
+    llvm::Constant *report = module.getOrInsertFunction(
+        PROFILER_REPORT_NAME, llvm::FunctionType::get(voidType, false)
+    );
+    for (llvm::BasicBlock &bb: *main) {
+        if (llvm::isa<llvm::ReturnInst>(bb.getTerminator())) {
+            d->builder.SetInsertPoint(bb.getTerminator());
+            d->builder.CreateCall(report);
+        }
+    }
+}
 
 static
 bool convertAndStore(BitcodeEmitter::Private *d, llvm::AllocaInst *dest, llvm::Value *expression) {
@@ -234,34 +816,146 @@ bool convertAndStore(BitcodeEmitter::Private *d, llvm::AllocaInst *dest, llvm::V
     return true;
 }
 
-BitcodeEmitter::BitcodeEmitter() {
+BitcodeEmitter::BitcodeEmitter(llvm::LLVMContext &context) {
     module = std::unique_ptr<llvm::Module>(
-        new llvm::Module("monicelli", getGlobalContext())
+        new llvm::Module("monicelli", context)
+    );
+    d = new Private(context);
+
+    std::string triple = configHas("target")?
+        config<std::string>("target"): llvm::sys::getDefaultTargetTriple();
+    selectTarget(triple, d->cpu, d->features);
+
+    // The builder puts these on all the floating point operations.
+    if (configHas("fast-math")) {
+        llvm::FastMathFlags flags;
+        flags.setUnsafeAlgebra();
+        d->builder.setFastMathFlags(flags);
+    }
+
+    // Without -O, only a few cheap passes are run, which keep the bitcode
+    // readable when disassembled.
+    bool optimize = configHas("optimize");
+    unsigned level = optimize? std::min(config<unsigned>("optimize"), 3u): 1;
+
+    d->target = Pointer<llvm::TargetMachine>(
+        createTargetMachine(triple, d->cpu, d->features, level)
     );
-    d = new Private;
+
+    if (d->target) {
+        module->setTargetTriple(triple);
+        module->setDataLayout(d->target->createDataLayout());
+    }
+
+    d->instrument = configHas("profile-generate");
+    d->profiler = configHas("profile");
+    d->profileLoops = d->profiler && configHas("profile-loops");
+    if (configHas("profile-use")) {
+        d->profile = loadProfile(config<std::string>("profile-use"));
+    }
+
+    d->triple = triple;
+    d->level = level;
+    d->optimize = optimize;
+    d->threads = configHas("threads")? std::max(config<unsigned>("threads"), 1u): 0;
+
+    if (configHas("memoize-size")) {
+        // At least two entries, so that the index is never shifted by 64.
+        unsigned entries = config<unsigned>("memoize-size");
+        for (d->memoBits = 1; d->memoBits < 24 && (1u << d->memoBits) < entries; ++d->memoBits);
+    }
+
+    std::string asserts = configHas("assert")? config<std::string>("assert"): "check";
+    if (asserts == "assume") {
+        d->asserts = Private::Asserts::ASSUME;
+    } else if (asserts == "off") {
+        d->asserts = Private::Asserts::OFF;
+    }
 
     d->optimizer = Pointer<llvm::legacy::FunctionPassManager>(
         new llvm::legacy::FunctionPassManager(module.get())
     );
 
-    d->optimizer->add(llvm::createBasicAliasAnalysisPass());
-    d->optimizer->add(llvm::createInstructionCombiningPass());
-    d->optimizer->add(llvm::createReassociatePass());
-    d->optimizer->add(llvm::createGVNPass());
-    d->optimizer->add(llvm::createCFGSimplificationPass());
-    d->optimizer->doInitialization();
+    if (!optimize) {
+        populateFunctionOptimizer(*d->optimizer, nullptr, nullptr);
+        return;
+    }
+
+    d->moduleOptimizer = Pointer<llvm::legacy::PassManager>(
+        new llvm::legacy::PassManager()
+    );
+
+    if (d->target) {
+        d->moduleOptimizer->add(llvm::createTargetTransformInfoWrapperPass(
+            d->target->getTargetIRAnalysis()
+        ));
+    }
+
+    llvm::PassManagerBuilder builder;
+    configureOptimizer(builder, triple, level);
+    populateFunctionOptimizer(*d->optimizer, d->target.get(), &builder);
+    builder.populateModulePassManager(*d->moduleOptimizer);
 }
 
 BitcodeEmitter::~BitcodeEmitter() {
     delete d;
 }
 
+bool BitcodeEmitter::emitObject(std::ostream &out) {
+    if (!d->target) return false;
+
+    llvm::SmallVector<char, 0> buffer;
+    llvm::raw_svector_ostream stream(buffer);
+    llvm::legacy::PassManager codegen;
+
+    if (d->target->addPassesToEmitFile(codegen, stream, llvm::TargetMachine::CGFT_ObjectFile)) {
+        diagnostics() << "Target cannot emit object files" << std::endl;
+        return false;
+    }
+
+    codegen.run(*module);
+    out.write(buffer.data(), buffer.size());
+
+    return static_cast<bool>(out);
+}
+
+Pointer<llvm::Module> BitcodeEmitter::takeModule() {
+    d->optimizer.reset();
+    d->moduleOptimizer.reset();
+    return std::move(module);
+}
+
 bool BitcodeEmitter::emit(Return const& node) {
     if (node.getExpression()) {
         GUARDED(node.getExpression()->emit(this));
-        llvm::Type *type = d->builder.GetInsertBlock()->getParent()->getReturnType();
+        llvm::Function *func = d->builder.GetInsertBlock()->getParent();
+        llvm::Value *value = coerce(d, d->retval, func->getReturnType());
+
+        // Calls in tail position return straight away, without going through
+        // the return variable, so that they really are tail calls. When the
+        // signatures match they are guaranteed to be. The profiler needs
+        // every return to pass through the exit block instead.
+        auto call = llvm::dyn_cast<llvm::CallInst>(d->retval);
+        bool isVoid = func->getReturnType()->isVoidTy();
+        if (call != nullptr && value != nullptr && d->functionSite == nullptr) {
+            bool exact = value == call && call->getFunctionType() == func->getFunctionType();
+            call->setTailCallKind(exact? llvm::CallInst::TCK_MustTail: llvm::CallInst::TCK_Tail);
+            if (isVoid) {
+                d->builder.CreateRetVoid();
+            } else {
+                d->builder.CreateRet(value);
+            }
+            return true;
+        }
+
+        // A void function only evaluates what it returns, for its effects.
+        if (isVoid) {
+            d->builder.CreateBr(d->funcExit);
+            return true;
+        }
+
         assert(d->funcRetval != nullptr);
-        d->builder.CreateStore(coerce(d, d->retval, type), d->funcRetval);
+        d->builder.CreateStore(value, d->funcRetval);
     }
 
     d->builder.CreateBr(d->funcExit);
@@ -273,14 +967,23 @@ bool BitcodeEmitter::emit(Loop const& node) {
     llvm::Function *father = d->builder.GetInsertBlock()->getParent();
 
     llvm::BasicBlock *body = llvm::BasicBlock::Create(
-        getGlobalContext(), "loop", father
+        d->context, "loop", father
     );
 
     d->builder.CreateBr(body);
     d->builder.SetInsertPoint(body);
 
+    if (d->profileLoops) {
+        llvm::Value *iterations = d->builder.CreateStructGEP(
+            nullptr, createProfilerSite(d, node, true), PROFILER_COUNT_FIELD
+        );
+        d->builder.CreateStore(d->builder.CreateAdd(
+            d->builder.CreateLoad(iterations), llvm::ConstantInt::get(llvm::Type::getInt64Ty(d->context), 1)
+        ), iterations);
+    }
+
     llvm::BasicBlock *condition = llvm::BasicBlock::Create(
-        getGlobalContext(), "loopcondition"
+        d->context, "loopcondition"
     );
 
     GUARDED(ensureBasicBlock(node.getBody(), condition));
@@ -293,10 +996,10 @@ bool BitcodeEmitter::emit(Loop const& node) {
     llvm::Value *loopTest = isTrue(d, d->retval, "looptest");
 
     llvm::BasicBlock *after = llvm::BasicBlock::Create(
-        getGlobalContext(), "afterloop", father
+        d->context, "afterloop", father
     );
 
-    d->builder.CreateCondBr(loopTest, body, after);
+    createProfiledBr(d, node, "loop", loopTest, body, after);
     d->builder.SetInsertPoint(after);
 
     return true;
@@ -304,7 +1007,7 @@ bool BitcodeEmitter::emit(Loop const& node) {
 
 bool BitcodeEmitter::emit(VarDeclaration const& node) {
     llvm::Function *father = d->builder.GetInsertBlock()->getParent();
-    llvm::Type *varType = LLVMType(node.getType());
+    llvm::Type *varType = LLVMType(node.getType(), d->context);
     llvm::AllocaInst *alloc = allocateVar(father, node.getId(), varType);
 
     if (node.getInitializer()) {
@@ -318,13 +1021,14 @@ bool BitcodeEmitter::emit(VarDeclaration const& node) {
 
     // TODO pointers
 
-    d->scope.push(node.getId().getValue(), alloc);
+    declareVariable(d, alloc, node.getId(), node.getType(), node, 0);
+    d->scope.push(node.getId().getSymbol(), alloc);
 
     return true;
 }
 
 bool BitcodeEmitter::emit(Assignment const& node) {
-    auto var = d->scope.lookup(node.getName().getValue());
+    auto var = d->scope.lookup(node.getName().getSymbol());
 
     if (!var) {
         return reportError(node, {
@@ -343,24 +1047,40 @@ bool BitcodeEmitter::emit(Assignment const& node) {
     return true;
 }
 
-bool BitcodeEmitter::emit(Print const& node) {
-    std::vector<llvm::Value*> callargs;
-    GUARDED(node.getExpression().emit(this));
-    callargs.push_back(d->retval);
+llvm::Function *BitcodeEmitter::getOrDeclare(std::string const& name) {
+    llvm::Function *func = module->getFunction(name);
+    if (func != nullptr) return func;
 
-    Type printType = MonicelliType(d->retval->getType());
+    FunctionPrototype const *proto = getModuleRegistry().lookup(intern(name));
+    if (proto == nullptr) return nullptr;
 
-    if (printType == Type::UNKNOWN) {
-        return reportError(node, {"Attempting to print unknown type"});
-    }
+    llvm::Value *retval = d->retval;
+    bool declared = proto->emit(this);
+    func = declared? llvm::cast<llvm::Function>(d->retval): nullptr;
+    d->retval = retval;
 
-    auto toCall = PUT_NAMES.find(printType);
+    return func;
+}
 
-    if (toCall == PUT_NAMES.end()) {
-        return reportError(node, {"Unknown print function for type"});
-    }
+llvm::Function *BitcodeEmitter::getOrDeclare(FunctionPrototype const& proto) {
+    llvm::Function *func = module->getFunction(proto.getName().getValue());
+    if (func != nullptr) return func;
 
-    llvm::Function *callee = module->getFunction(toCall->second);
+    llvm::Value *retval = d->retval;
+    bool declared = proto.emit(this);
+    func = declared? llvm::cast<llvm::Function>(d->retval): nullptr;
+    d->retval = retval;
+
+    return func;
+}
+
+bool BitcodeEmitter::emit(Print const& node) {
+    std::vector<llvm::Value*> callargs;
+    GUARDED(node.getExpression().emit(this));
+    callargs.push_back(d->retval);
+
+    assert(node.getCallee() != nullptr);
+    llvm::Function *callee = getOrDeclare(*node.getCallee());
 
     if (callee == nullptr) {
         return reportError(node, {"Print function was not registered"});
@@ -372,7 +1092,7 @@ bool BitcodeEmitter::emit(Print const& node) {
 }
 
 bool BitcodeEmitter::emit(Input const& node) {
-    auto lookupResult = d->scope.lookup(node.getVariable().getValue());
+    auto lookupResult = d->scope.lookup(node.getVariable().getSymbol());
 
     if (!lookupResult) {
         return reportError(node, {
@@ -381,88 +1101,301 @@ bool BitcodeEmitter::emit(Input const& node) {
         });
     }
 
-    llvm::AllocaInst *variable = *lookupResult;
-    Type inputType = MonicelliType(variable->getAllocatedType());
+    assert(node.getCallee() != nullptr);
+    llvm::Function *callee = getOrDeclare(*node.getCallee());
+
+    if (callee == nullptr) {
+        return reportError(node, {
+            "Input function was not registered for type"
+        });
+    }
+
+    llvm::Value *readval = d->builder.CreateCall(callee);
+    d->builder.CreateStore(readval, *lookupResult);
+
+    return true;
+}
+
+bool BitcodeEmitter::emit(Abort const& node) {
+    llvm::Function *callee = getOrDeclare(ABORT_NAME);
+
+    if (callee == nullptr) {
+        return reportError(node, {"Abort function was not registered"});
+    }
+
+    d->builder.CreateCall(callee);
+
+    return true;
+}
+
+bool BitcodeEmitter::emit(Assert const& node) {
+    if (d->asserts == Private::Asserts::OFF) return true;
+
+    GUARDED(node.getExpression().emit(this));
+    llvm::Value *condition = isTrue(d, d->retval, "assertion");
+
+    // Later passes take the condition as a fact, e.g. for value ranges.
+    // Whatever only feeds the assumption is removed after that.
+    if (d->asserts == Private::Asserts::ASSUME) {
+        d->builder.CreateCall(
+            llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::assume), {condition}
+        );
+        return true;
+    }
+
+    llvm::Function *callee = getOrDeclare(ASSERT_NAME);
+
+    if (callee == nullptr) {
+        return reportError(node, {"Assert function was not registered"});
+    }
+
+    // Only a failing assertion calls the runtime, holding ones cost a
+    // compare and a branch which is predicted taken.
+    callee->addFnAttr(llvm::Attribute::Cold);
+
+    llvm::Function *func = d->builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock *failed = llvm::BasicBlock::Create(d->context, "assertfailed", func);
+    llvm::BasicBlock *holds = llvm::BasicBlock::Create(d->context, "assertholds", func);
+
+    d->builder.CreateCondBr(
+        condition, holds, failed, llvm::MDBuilder(d->context).createBranchWeights(2000, 1)
+    );
+
+    d->builder.SetInsertPoint(failed);
+    d->builder.CreateCall(callee, {llvm::ConstantInt::getFalse(d->context)});
+    d->builder.CreateBr(holds);
+
+    d->builder.SetInsertPoint(holds);
+
+    return true;
+}
+
+bool BitcodeEmitter::emit(FunctionCall const& node) {
+    DebugLocation location(d, node);
+    assert(node.getCallee() != nullptr);
+    llvm::Function *callee = getOrDeclare(*node.getCallee());
+
+    if (callee == 0) {
+        return reportError(node, {
+            "Attempting to call undefined function",
+            node.getName().getValue() + "()"
+        });
+    }
+
+    if (callee->arg_size() != node.getArgs().size()) {
+        return reportError(node, {
+            "Argument number mismatch in call of",
+            node.getName().getValue() + "()",
+            "expected", std::to_string(callee->arg_size()),
+            "given", std::to_string(node.getArgs().size())
+        });
+    }
+
+    auto param = callee->getArgumentList().begin();
+    std::vector<llvm::Value*> callargs;
+    for (Expression const& arg: node.getArgs()) {
+        GUARDED(arg.emit(this));
+        callargs.push_back(coerce(d, d->retval, param->getType()));
+        ++param;
+    }
+
+    d->retval = d->builder.CreateCall(callee, callargs);
+
+    if (callee == d->builder.GetInsertBlock()->getParent()) {
+        d->selfCalls.push_back({
+            llvm::WeakVH(d->retval), node.getLocation().begin.line, node.getLocation().begin.column
+        });
+    }
+
+    return true;
+}
+
+static
+bool isConstantCase(BranchCase const& cas) {
+    switch (cas.getCondition().getOperator()) {
+        case Operator::EQ:
+        case Operator::LT:
+        case Operator::GT:
+        case Operator::LTE:
+        case Operator::GTE:
+            break;
+        default:
+            return false;
+    }
+
+    return dynamic_cast<Integer const*>(&cas.getCondition().getLeft()) != nullptr;
+}
+
+static
+uint64_t caseBound(BranchCase const& cas) {
+    Integer const& bound = dynamic_cast<Integer const&>(cas.getCondition().getLeft());
+    return static_cast<uint64_t>(bound.getValue());
+}
+
+// Comparisons are unsigned, as in createOp.
+static
+bool caseMatches(BranchCase const& cas, uint64_t value) {
+    uint64_t bound = caseBound(cas);
+
+    switch (cas.getCondition().getOperator()) {
+        case Operator::EQ:
+            return value == bound;
+        case Operator::LT:
+            return value < bound;
+        case Operator::GT:
+            return value > bound;
+        case Operator::LTE:
+            return value <= bound;
+        case Operator::GTE:
+            return value >= bound;
+        default:
+            return false;
+    }
+}
+
+struct CaseRange {
+    uint64_t begin;
+    llvm::BasicBlock *target;
+};
+
+/**
+ * Splits the value domain in ranges where the first matching case does
+ * not change, then merges neighbouring ranges going to the same block.
+ */
+static
+std::vector<CaseRange> caseRanges(PointerList<BranchCase> const& cases,
+                                  std::vector<llvm::BasicBlock*> const& targets,
+                                  llvm::BasicBlock *fallback) {
+    std::set<uint64_t> bounds = {0};
+
+    for (BranchCase const& cas: cases) {
+        uint64_t bound = caseBound(cas);
+        bounds.insert(bound);
+        if (bound != std::numeric_limits<uint64_t>::max()) {
+            bounds.insert(bound + 1);
+        }
+    }
+
+    std::vector<CaseRange> ranges;
 
-    if (inputType == Type::UNKNOWN) {
-        return reportError(node, {"Attempting to read unknown type"});
-    }
+    for (uint64_t begin: bounds) {
+        llvm::BasicBlock *target = fallback;
 
-    auto toCall = GET_NAMES.find(inputType);
+        for (size_t i = 0; i < cases.size(); ++i) {
+            if (caseMatches(cases[i], begin)) {
+                target = targets[i];
+                break;
+            }
+        }
 
-    if (toCall == GET_NAMES.end()) {
-        return reportError(node, {
-            "Unknown input function for type"
-        });
+        if (ranges.empty() || ranges.back().target != target) {
+            ranges.push_back({begin, target});
+        }
     }
 
-    llvm::Function *callee = module->getFunction(toCall->second);
+    return ranges;
+}
 
-    if (callee == nullptr) {
-        return reportError(node, {
-            "Input function was not registered for type"
-        });
+static
+void emitRangeTree(BitcodeEmitter::Private *d, llvm::Value *value,
+                   std::vector<CaseRange> const& ranges, size_t begin, size_t end) {
+    if (end - begin == 1) {
+        d->builder.CreateBr(ranges[begin].target);
+        return;
     }
 
-    llvm::Value *readval = d->builder.CreateCall(callee);
-    d->builder.CreateStore(readval, variable);
+    llvm::Function *func = d->builder.GetInsertBlock()->getParent();
+    size_t middle = begin + (end - begin) / 2;
 
-    return true;
-}
+    llvm::BasicBlock *left = middle - begin == 1?
+        ranges[begin].target: llvm::BasicBlock::Create(d->context, "range", func);
+    llvm::BasicBlock *right = end - middle == 1?
+        ranges[middle].target: llvm::BasicBlock::Create(d->context, "range", func);
 
-bool BitcodeEmitter::emit(Abort const& node) {
-    llvm::Function *callee = module->getFunction(ABORT_NAME);
+    llvm::Value *pivot = llvm::ConstantInt::get(
+        d->context, llvm::APInt(64, ranges[middle].begin)
+    );
+    d->builder.CreateCondBr(d->builder.CreateICmpULT(value, pivot), left, right);
 
-    if (callee == nullptr) {
-        return reportError(node, {"Abort function was not registered"});
+    if (middle - begin > 1) {
+        d->builder.SetInsertPoint(left);
+        emitRangeTree(d, value, ranges, begin, middle);
     }
 
-    d->builder.CreateCall(callee);
-
-    return true;
+    if (end - middle > 1) {
+        d->builder.SetInsertPoint(right);
+        emitRangeTree(d, value, ranges, middle, end);
+    }
 }
 
-bool BitcodeEmitter::emit(Assert const& node) {
-    llvm::Function *callee = module->getFunction(ASSERT_NAME);
+bool BitcodeEmitter::emitConstantBranch(Branch const& node) {
+    Branch::Body const& body = node.getBody();
+    PointerList<BranchCase> const& cases = body.getCases();
+    llvm::Function *func = d->builder.GetInsertBlock()->getParent();
 
-    if (callee == nullptr) {
-        return reportError(node, {"Assert function was not registered"});
+    GUARDED(node.getVar().emit(this));
+    llvm::Value *value = d->retval;
+
+    std::vector<llvm::BasicBlock*> targets;
+    for (size_t i = 0; i < cases.size(); ++i) {
+        targets.push_back(llvm::BasicBlock::Create(d->context, "then"));
     }
 
-    node.getExpression().emit(this);
-    d->builder.CreateCall(callee, {coerce(d, d->retval, LLVMType(Type::BOOL))});
+    llvm::BasicBlock *elsebb = llvm::BasicBlock::Create(d->context, "else");
+    llvm::BasicBlock *mergebb = llvm::BasicBlock::Create(d->context, "endif");
 
-    return true;
-}
+    bool equalities = std::all_of(cases.begin(), cases.end(), [](BranchCase const& cas) {
+        return cas.getCondition().getOperator() == Operator::EQ;
+    });
 
-bool BitcodeEmitter::emit(FunctionCall const& node) {
-    llvm::Function *callee = module->getFunction(node.getName().getValue());
+    if (equalities) {
+        llvm::SwitchInst *dispatch = d->builder.CreateSwitch(value, elsebb, cases.size());
+        std::set<uint64_t> seen;
+        std::vector<uint64_t> counts;
 
-    if (callee == 0) {
-        return reportError(node, {
-            "Attempting to call undefined function",
-            node.getName().getValue() + "()"
-        });
+        if (d->profile) {
+            counts.push_back(profileCount(d, profileKey(d, node, "else")));
+        }
+
+        for (size_t i = 0; i < cases.size(); ++i) {
+            uint64_t bound = caseBound(cases[i]);
+            if (!seen.insert(bound).second) continue;
+            dispatch->addCase(
+                llvm::ConstantInt::get(d->context, llvm::APInt(64, bound)), targets[i]
+            );
+            if (d->profile) {
+                counts.push_back(profileCount(d, profileKey(d, node, "case" + std::to_string(i))));
+            }
+        }
+
+        llvm::MDNode *weights = d->profile? branchWeights(d, counts): nullptr;
+        if (weights) dispatch->setMetadata(llvm::LLVMContext::MD_prof, weights);
+    } else {
+        // The range tree is not weighted, its comparisons do not map to
+        // single cases.
+        std::vector<CaseRange> ranges = caseRanges(cases, targets, elsebb);
+        emitRangeTree(d, value, ranges, 0, ranges.size());
     }
 
-    if (callee->arg_size() != node.getArgs().size()) {
-        return reportError(node, {
-            "Argument number mismatch in call of",
-            node.getName().getValue() + "()",
-            "expected", std::to_string(callee->arg_size()),
-            "given", std::to_string(node.getArgs().size())
-        });
+    for (size_t i = 0; i < cases.size(); ++i) {
+        func->getBasicBlockList().push_back(targets[i]);
+        d->builder.SetInsertPoint(targets[i]);
+        countBlock(d, profileKey(d, node, "case" + std::to_string(i)));
+        GUARDED(ensureBasicBlock(cases[i].getBody(), mergebb));
     }
 
-    auto param = callee->getArgumentList().begin();
-    std::vector<llvm::Value*> callargs;
-    for (Expression const& arg: node.getArgs()) {
-        GUARDED(arg.emit(this));
-        callargs.push_back(coerce(d, d->retval, param->getType()));
-        ++param;
+    func->getBasicBlockList().push_back(elsebb);
+    d->builder.SetInsertPoint(elsebb);
+    countBlock(d, profileKey(d, node, "else"));
+
+    if (body.getElse()) {
+        GUARDED(ensureBasicBlock(*body.getElse(), mergebb));
+    } else {
+        d->builder.CreateBr(mergebb);
     }
 
-    d->retval = d->builder.CreateCall(callee, callargs);
+    func->getBasicBlockList().push_back(mergebb);
+    d->builder.SetInsertPoint(mergebb);
 
     return true;
 }
@@ -471,22 +1404,35 @@ bool BitcodeEmitter::emit(Branch const& node) {
     Branch::Body const& body = node.getBody();
     llvm::Function *func = d->builder.GetInsertBlock()->getParent();
 
+    // Dispatch on a Necchi against integer constants is lowered to a switch,
+    // or to a binary search over ranges, instead of a chain of compares.
+    auto var = d->scope.lookup(node.getVar().getSymbol());
+    bool constantCases = std::all_of(
+        body.getCases().begin(), body.getCases().end(), isConstantCase
+    );
+
+    if (var && (*var)->getAllocatedType()->isIntegerTy(64) && constantCases) {
+        return emitConstantBranch(node);
+    }
+
     llvm::BasicBlock *thenbb = llvm::BasicBlock::Create(
-        getGlobalContext(), "then", func
+        d->context, "then", func
     );
     llvm::BasicBlock *elsebb = llvm::BasicBlock::Create(
-        getGlobalContext(), "else"
+        d->context, "else"
     );
     llvm::BasicBlock *mergebb = llvm::BasicBlock::Create(
-        getGlobalContext(), "endif"
+        d->context, "endif"
     );
 
     assert(!body.getCases().empty());
     BranchCase const& last = body.getCases().back();
+    size_t index = 0;
 
     for (BranchCase const& cas: body.getCases()) {
         emitSemiExpression(node.getVar(), cas.getCondition());
-        d->builder.CreateCondBr(
+        createProfiledBr(
+            d, node, "case" + std::to_string(index++),
             isTrue(d, d->retval, "condition"), thenbb, elsebb
         );
         d->builder.SetInsertPoint(thenbb);
@@ -497,8 +1443,8 @@ bool BitcodeEmitter::emit(Branch const& node) {
         d->builder.SetInsertPoint(elsebb);
 
         if (&cas != &last) {
-            thenbb = llvm::BasicBlock::Create(getGlobalContext(), "then", func);
-            elsebb = llvm::BasicBlock::Create(getGlobalContext(), "else");
+            thenbb = llvm::BasicBlock::Create(d->context, "then", func);
+            elsebb = llvm::BasicBlock::Create(d->context, "else");
         }
     }
 
@@ -518,7 +1464,7 @@ bool BitcodeEmitter::emit(FunctionPrototype const& node) {
     std::vector<llvm::Type*> argTypes;
 
     for (FunArg const& arg: node.getArgs()) {
-        argTypes.emplace_back(LLVMType(arg.getType()));
+        argTypes.emplace_back(LLVMType(arg.getType(), d->context));
     }
 
     std::unordered_set<std::string> argsSet;
@@ -534,7 +1480,7 @@ bool BitcodeEmitter::emit(FunctionPrototype const& node) {
     }
 
     llvm::FunctionType *ftype = llvm::FunctionType::get(
-        LLVMType(node.getType()), argTypes, false
+        LLVMType(node.getType(), d->context), argTypes, false
     );
 
     llvm::Function *func = llvm::Function::Create(
@@ -572,35 +1518,480 @@ bool BitcodeEmitter::emit(FunctionPrototype const& node) {
     return true;
 }
 
+/**
+ * Lists the recursive calls of func which are still there after tail
+ * recursion elimination and are not guaranteed tail calls either, so each
+ * of them takes a stack frame.
+ */
+static
+void reportRecursion(BitcodeEmitter::Private *d, llvm::Function *func) {
+    for (SelfCall const& self: d->selfCalls) {
+        auto call = llvm::dyn_cast_or_null<llvm::CallInst>(static_cast<llvm::Value*>(self.call));
+        if (call == nullptr || call->getCalledFunction() != func || call->isMustTailCall()) continue;
+
+        diagnostics() << "line " << self.line << ", col " << self.column << ": "
+                      << "recursive call to " << func->getName().str()
+                      << "() could not be turned into a loop" << std::endl;
+    }
+}
+
+// 2^64 divided by the golden ratio, the top bits of keys multiplied by it
+// are well spread even when keys are consecutive.
+static const uint64_t FIBONACCI_HASH = 0x9e3779b97f4a7c15ull;
+
+/**
+ * Makes func look its arguments up in a direct-mapped table of earlier
+ * results, calling the function returned, where the body should go, only
+ * on a miss. Recursive calls in the body then go through the table too.
+ */
+static
+llvm::Function* emitMemoized(BitcodeEmitter::Private *d, llvm::Module &module, Function const& node, llvm::Function *func) {
+    llvm::Function *body = llvm::Function::Create(
+        func->getFunctionType(), llvm::Function::InternalLinkage, func->getName() + ".body", &module
+    );
+    body->copyAttributesFrom(func);
+    body->setLinkage(llvm::Function::InternalLinkage);
+
+    // Entries are the arguments, the result and whether they are filled.
+    llvm::Type *keyType = llvm::Type::getInt64Ty(d->context);
+    std::vector<llvm::Type*> fields(func->arg_size(), keyType);
+    fields.push_back(func->getReturnType());
+    fields.push_back(llvm::Type::getInt1Ty(d->context));
+    unsigned resultField = func->arg_size();
+    unsigned filledField = resultField + 1;
+
+    llvm::ArrayType *tableType = llvm::ArrayType::get(
+        llvm::StructType::get(d->context, fields), uint64_t(1) << d->memoBits
+    );
+    llvm::GlobalVariable *table = new llvm::GlobalVariable(
+        module, tableType, false, llvm::GlobalValue::InternalLinkage,
+        llvm::ConstantAggregateZero::get(tableType), func->getName() + ".memo"
+    );
+
+    // Not the emitter's builder, this code has no location in the source.
+    llvm::IRBuilder<> builder(llvm::BasicBlock::Create(d->context, "entry", func));
+
+    std::vector<llvm::Value*> args;
+    std::vector<llvm::Value*> keys;
+    llvm::Value *hash = llvm::ConstantInt::get(keyType, 0);
+    for (llvm::Argument &arg: func->args()) {
+        args.push_back(&arg);
+        keys.push_back(builder.CreateSExt(&arg, keyType));
+        hash = builder.CreateMul(
+            builder.CreateAdd(hash, keys.back()), llvm::ConstantInt::get(keyType, FIBONACCI_HASH)
+        );
+    }
+
+    llvm::Value *index = builder.CreateLShr(hash, 64 - d->memoBits);
+    llvm::Value *entry = builder.CreateInBoundsGEP(
+        tableType, table, {llvm::ConstantInt::get(keyType, 0), index}
+    );
+
+    llvm::Value *hit = builder.CreateLoad(builder.CreateStructGEP(nullptr, entry, filledField));
+    for (unsigned i = 0; i < keys.size(); ++i) {
+        llvm::Value *key = builder.CreateLoad(builder.CreateStructGEP(nullptr, entry, i));
+        hit = builder.CreateAnd(hit, builder.CreateICmpEQ(key, keys[i]));
+    }
+
+    llvm::BasicBlock *cached = llvm::BasicBlock::Create(d->context, "cached", func);
+    llvm::BasicBlock *compute = llvm::BasicBlock::Create(d->context, "compute", func);
+    builder.CreateCondBr(hit, cached, compute);
+
+    builder.SetInsertPoint(cached);
+    builder.CreateRet(builder.CreateLoad(builder.CreateStructGEP(nullptr, entry, resultField)));
+
+    builder.SetInsertPoint(compute);
+    llvm::Value *result = builder.CreateCall(body, args);
+    for (unsigned i = 0; i < keys.size(); ++i) {
+        builder.CreateStore(keys[i], builder.CreateStructGEP(nullptr, entry, i));
+    }
+    builder.CreateStore(result, builder.CreateStructGEP(nullptr, entry, resultField));
+    builder.CreateStore(llvm::ConstantInt::getTrue(d->context), builder.CreateStructGEP(nullptr, entry, filledField));
+    builder.CreateRet(result);
+
+    if (configHas("memoize-report")) {
+        diagnostics() << "line " << node.getLocation().begin.line << ", "
+                      << "col " << node.getLocation().begin.column << ": "
+                      << "memoizing " << func->getName().str() << "() in "
+                      << (uint64_t(1) << d->memoBits) << " entries" << std::endl;
+    }
+
+    return body;
+}
+
+static
+size_t instructionCount(llvm::Function const& func) {
+    size_t count = 0;
+    for (llvm::BasicBlock const& bb: func) {
+        count += bb.size();
+    }
+    return count;
+}
+
+// Partitions do not depend on --threads, which then does not change the
+// output either: functions go to the same partition whatever it is.
+static const unsigned MAX_PARTITIONS = 8;
+
+static
+bool optimizesPartitions(BitcodeEmitter::Private *d) {
+    // Reporting recursion needs the calls as emitted, next to the optimized function.
+    return d->threads > 0 && !configHas("report-recursion");
+}
+
+struct FunctionStats {
+    std::string name;
+    double wall;
+    size_t before;
+    size_t after;
+};
+
+/**
+ * Part of a module, handed between contexts as bitcode, and then as the
+ * object file compiled from it.
+ */
+struct Partition {
+    llvm::SmallVector<char, 0> buffer;
+    std::vector<FunctionStats> stats;
+    std::string error;
+    // Written to diagnostics() while working on it, replayed afterwards.
+    std::string diagnostics;
+};
+
+static
+void writeBitcode(llvm::Module const& module, llvm::SmallVector<char, 0> &buffer) {
+    buffer.clear();
+    llvm::raw_svector_ostream stream(buffer);
+    llvm::WriteBitcodeToFile(&module, stream);
+}
+
+static
+Pointer<llvm::Module> readBitcode(llvm::SmallVector<char, 0> const& buffer,
+                                  llvm::LLVMContext &context, std::string &error) {
+    llvm::MemoryBufferRef bitcode(llvm::StringRef(buffer.data(), buffer.size()), "partition");
+    auto module = llvm::parseBitcodeFile(bitcode, context);
+
+    if (!module) {
+        error = module.getError().message();
+        return nullptr;
+    }
+
+    return std::move(module.get());
+}
+
+/**
+ * Order and linkage of what is in a module, which do not survive splitting
+ * it: parts are linked back in their own order, and locals are made
+ * visible to the other parts.
+ */
+struct ModuleLayout {
+    std::vector<std::string> functions;
+    std::vector<std::string> variables;
+    std::vector<std::pair<std::string, llvm::GlobalValue::LinkageTypes>> locals;
+};
+
+static
+ModuleLayout recordLayout(llvm::Module &module) {
+    ModuleLayout layout;
+
+    auto recordLocal = [&](llvm::GlobalValue &value) {
+        if (!value.hasLocalLinkage()) return;
+        if (!value.hasName()) value.setName("local");
+        layout.locals.emplace_back(value.getName().str(), value.getLinkage());
+    };
+
+    for (llvm::Function &func: module) {
+        recordLocal(func);
+        layout.functions.push_back(func.getName().str());
+    }
+
+    for (llvm::GlobalVariable &var: module.globals()) {
+        recordLocal(var);
+        layout.variables.push_back(var.getName().str());
+    }
+
+    return layout;
+}
+
+static
+void restoreLayout(llvm::Module &module, ModuleLayout const& layout) {
+    for (std::string const& name: layout.functions) {
+        llvm::Function *func = module.getFunction(name);
+        if (func == nullptr) continue;
+        func->removeFromParent();
+        module.getFunctionList().push_back(func);
+    }
+
+    for (std::string const& name: layout.variables) {
+        llvm::GlobalVariable *var = module.getGlobalVariable(name, true);
+        if (var == nullptr) continue;
+        var->removeFromParent();
+        module.getGlobalList().push_back(var);
+    }
+
+    for (auto const& local: layout.locals) {
+        llvm::GlobalValue *value = module.getNamedValue(local.first);
+        if (value == nullptr) continue;
+        value->setVisibility(llvm::GlobalValue::DefaultVisibility);
+        value->setLinkage(local.second);
+    }
+}
+
+/**
+ * Splits the module in up to MAX_PARTITIONS parts, each declaring what it
+ * uses from the others. Functions go to parts by a hash of their name.
+ */
+static
+std::vector<Partition> splitModule(Pointer<llvm::Module> module) {
+    size_t functions = 0;
+    for (llvm::Function const& func: *module) {
+        if (!func.isDeclaration()) ++functions;
+    }
+
+    unsigned count = std::max<size_t>(std::min<size_t>(functions, MAX_PARTITIONS), 1);
+    std::vector<Partition> partitions;
+
+    llvm::SplitModule(std::move(module), count, [&](std::unique_ptr<llvm::Module> part) {
+        partitions.emplace_back();
+        writeBitcode(*part, partitions.back().buffer);
+    });
+
+    return partitions;
+}
+
+/**
+ * Runs job on every partition on up to threads threads, the calling one
+ * included, each partition in a context of its own since contexts cannot
+ * be shared. Threads take the next partition nobody started yet from a
+ * shared counter; with at most 8 partitions, stealing would not pay.
+ * Diagnostics are written on the calling thread at the end, in partition
+ * order.
+ */
+static
+void runPartitions(std::vector<Partition> &partitions, unsigned threads,
+                   std::function<void(Partition&, llvm::LLVMContext&)> const& job) {
+    std::atomic<size_t> next(0);
+
+    auto work = [&]() {
+        for (size_t i = next++; i < partitions.size(); i = next++) {
+            std::ostringstream messages;
+            std::ostream *previous = setDiagnosticsStream(&messages);
+            {
+                llvm::LLVMContext context;
+                job(partitions[i], context);
+            }
+            setDiagnosticsStream(previous);
+            partitions[i].diagnostics = messages.str();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    size_t workers = std::min<size_t>(threads, partitions.size());
+
+    for (size_t i = 1; i < workers; ++i) {
+        pool.emplace_back(work);
+    }
+
+    work();
+
+    for (std::thread &worker: pool) {
+        worker.join();
+    }
+
+    for (Partition const& part: partitions) {
+        diagnostics() << part.diagnostics;
+    }
+}
+
+/**
+ * Runs the function passes on the partitions of the module concurrently,
+ * then links them back into a module laid out like the original one.
+ */
+static
+Pointer<llvm::Module> optimizePartitions(BitcodeEmitter::Private *d, Pointer<llvm::Module> module) {
+    TimeReport::Phase phase("optimize-function");
+
+    llvm::LLVMContext &context = module->getContext();
+    std::string triple = module->getTargetTriple();
+    llvm::DataLayout dataLayout = module->getDataLayout();
+    ModuleLayout layout = recordLayout(*module);
+
+    std::vector<Partition> partitions = splitModule(std::move(module));
+
+    runPartitions(partitions, d->threads, [d](Partition &part, llvm::LLVMContext &context) {
+        Pointer<llvm::Module> module = readBitcode(part.buffer, context, part.error);
+        if (!module) return;
+
+        Pointer<llvm::TargetMachine> target;
+        llvm::legacy::FunctionPassManager optimizer(module.get());
+
+        if (d->optimize) {
+            target.reset(createTargetMachine(d->triple, d->cpu, d->features, d->level));
+            llvm::PassManagerBuilder builder;
+            configureOptimizer(builder, d->triple, d->level);
+            populateFunctionOptimizer(optimizer, target.get(), &builder);
+        } else {
+            populateFunctionOptimizer(optimizer, nullptr, nullptr);
+        }
+
+        for (llvm::Function &func: *module) {
+            if (func.isDeclaration()) continue;
+
+            size_t before = instructionCount(func);
+            auto start = std::chrono::steady_clock::now();
+            optimizer.run(func);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            part.stats.push_back({
+                func.getName().str(), elapsed.count(), before, instructionCount(func)
+            });
+        }
+
+        optimizer.doFinalization();
+        writeBitcode(*module, part.buffer);
+    });
+
+    Pointer<llvm::Module> merged(new llvm::Module("monicelli", context));
+    merged->setTargetTriple(triple);
+    merged->setDataLayout(dataLayout);
+
+    for (Partition &part: partitions) {
+        Pointer<llvm::Module> optimized;
+        if (part.error.empty()) {
+            optimized = readBitcode(part.buffer, context, part.error);
+        }
+
+        if (!optimized) {
+            diagnostics() << "Cannot optimize module partition: " << part.error << std::endl;
+            return nullptr;
+        }
+
+        if (llvm::Linker::linkModules(*merged, std::move(optimized))) {
+            diagnostics() << "Cannot link optimized module partitions" << std::endl;
+            return nullptr;
+        }
+
+        if (TimeReport::current() != nullptr) {
+            for (FunctionStats const& stat: part.stats) {
+                TimeReport::current()->addFunction(stat.name, stat.wall, stat.before, stat.after);
+            }
+        }
+    }
+
+    restoreLayout(*merged, layout);
+
+    return merged;
+}
+
+bool BitcodeEmitter::emitObjects(std::vector<std::string> &objects) {
+    if (!d->target) return false;
+
+    if (d->threads == 0) {
+        std::ostringstream object;
+        GUARDED(emitObject(object));
+        objects.push_back(object.str());
+        return true;
+    }
+
+    std::vector<Partition> partitions = splitModule(std::move(module));
+
+    runPartitions(partitions, d->threads, [this](Partition &part, llvm::LLVMContext &context) {
+        Pointer<llvm::Module> module = readBitcode(part.buffer, context, part.error);
+        if (!module) return;
+
+        Pointer<llvm::TargetMachine> target(
+            createTargetMachine(d->triple, d->cpu, d->features, d->level)
+        );
+
+        part.buffer.clear();
+        llvm::raw_svector_ostream stream(part.buffer);
+        llvm::legacy::PassManager codegen;
+
+        if (!target || target->addPassesToEmitFile(codegen, stream, llvm::TargetMachine::CGFT_ObjectFile)) {
+            part.error = "target cannot emit object files";
+            return;
+        }
+
+        codegen.run(*module);
+    });
+
+    for (Partition const& part: partitions) {
+        if (!part.error.empty()) {
+            diagnostics() << "Cannot compile module partition: " << part.error << std::endl;
+            return false;
+        }
+        objects.emplace_back(part.buffer.data(), part.buffer.size());
+    }
+
+    return true;
+}
+
 bool BitcodeEmitter::emit(Function const& node) {
     GUARDED(node.getPrototype().emit(this));
-    llvm::Function *func = dynamic_cast<llvm::Function*>(d->retval);
+    llvm::Function *func = llvm::cast<llvm::Function>(d->retval);
 
     assert(func != nullptr);
 
+    // Passes read the CPU from the function, including the vectorizers.
+    if (!d->cpu.empty()) {
+        func->addFnAttr("target-cpu", d->cpu);
+    }
+
+    if (!d->features.empty()) {
+        func->addFnAttr("target-features", d->features);
+    }
+
+    if (configHas("fast-math")) {
+        func->addFnAttr("unsafe-fp-math", "true");
+        func->addFnAttr("no-infs-fp-math", "true");
+        func->addFnAttr("no-nans-fp-math", "true");
+    }
+
+    if (d->memoized.count(node.getPrototype().getName().getSymbol())) {
+        func = emitMemoized(d, *module, node, func);
+    }
+
     llvm::BasicBlock *bb = llvm::BasicBlock::Create(
-        getGlobalContext(), "entry", func
+        d->context, "entry", func
     );
     d->builder.SetInsertPoint(bb);
 
+    d->function = node.getPrototype().getName().getValue();
+    d->functionLine = node.getLocation().begin.line;
+    startDebugFunction(d, node, func);
+    countBlock(d, d->function + ":entry");
+
+    d->functionSite = nullptr;
+    if (d->profiler) {
+        d->functionSite = createProfilerSite(d, node, false);
+        callProfiler(d, PROFILER_ENTER_NAME, d->functionSite);
+    }
+
+    if (d->profile) {
+        auto entries = d->profile->find(d->function + ":entry");
+        if (entries != d->profile->end()) func->setEntryCount(entries->second);
+    }
+
     bool isNotVoid = node.getPrototype().getType() != Type::VOID;
 
     d->funcRetval = isNotVoid? allocateReturnVariable(func): nullptr;
-    d->funcExit = llvm::BasicBlock::Create(getGlobalContext(), "return");
+    d->funcExit = llvm::BasicBlock::Create(d->context, "return");
 
     d->scope.enter();
 
     auto argToAlloc = func->arg_begin();
+    unsigned argNumber = 1;
     for (FunArg const& arg: node.getPrototype().getArgs()) {
         llvm::AllocaInst *alloc = allocateVar(
-            func, arg.getName(), LLVMType(arg.getType())
+            func, arg.getName(), LLVMType(arg.getType(), d->context)
         );
-        d->builder.CreateStore(argToAlloc, alloc);
-        d->scope.push(arg.getName().getValue(), alloc);
+        declareVariable(d, alloc, arg.getName(), arg.getType(), node, argNumber++);
+        d->builder.CreateStore(&*argToAlloc, alloc);
+        d->scope.push(arg.getName().getSymbol(), alloc);
         ++argToAlloc;
     }
 
     for (Statement const& stat: node.getBody()) {
+        DebugLocation location(d, stat);
         GUARDED(stat.emit(this));
     }
 
@@ -613,15 +2004,40 @@ bool BitcodeEmitter::emit(Function const& node) {
     func->getBasicBlockList().push_back(d->funcExit);
     d->builder.SetInsertPoint(d->funcExit);
 
+    if (d->functionSite != nullptr) {
+        callProfiler(d, PROFILER_EXIT_NAME, d->functionSite);
+    }
+
     if (isNotVoid) {
         d->builder.CreateRet(d->builder.CreateLoad(d->funcRetval));
     } else {
         d->builder.CreateRetVoid();
     }
 
+    endDebugFunction(d);
     verifyFunction(*func);
 
-    d->optimizer->run(*func);
+    if (optimizesPartitions(d)) {
+        // Left for optimizePartitions(), once the whole module is there.
+    } else if (TimeReport::current() != nullptr) {
+        size_t before = instructionCount(*func);
+        auto start = std::chrono::steady_clock::now();
+        {
+            TimeReport::Phase phase("optimize-function");
+            d->optimizer->run(*func);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        TimeReport::current()->addFunction(
+            func->getName().str(), elapsed.count(), before, instructionCount(*func)
+        );
+    } else {
+        d->optimizer->run(*func);
+    }
+
+    if (configHas("report-recursion")) {
+        reportRecursion(d, func);
+    }
+    d->selfCalls.clear();
 
     return true;
 }
@@ -630,10 +2046,73 @@ bool BitcodeEmitter::emit(Module const& node) {
     return true;
 }
 
+std::string monicelli::getTargetFingerprint() {
+    std::string triple = configHas("target")?
+        config<std::string>("target"): llvm::sys::getDefaultTargetTriple();
+    std::string cpu;
+    std::string features;
+    selectTarget(triple, cpu, features);
+
+    return triple + '\n' + cpu + '\n' + features;
+}
+
+std::vector<std::string> monicelli::getLinkedLibraries() {
+    std::vector<std::string> libraries;
+
+    if (configHas("link-runtime")) {
+        libraries.push_back(config<std::string>("runtime-path") + "/mcrt.bc");
+    }
+
+    if (configHas("link-bitcode")) {
+        auto const& extra = config<std::vector<std::string>>("link-bitcode");
+        libraries.insert(libraries.end(), extra.begin(), extra.end());
+    }
+
+    return libraries;
+}
+
+static
+bool linkLibraries(llvm::Module &module) {
+    std::vector<std::string> libraries = getLinkedLibraries();
+    if (libraries.empty()) return true;
+
+    TimeReport::Phase phase("link-bitcode");
+
+    for (std::string const& path: libraries) {
+        llvm::SMDiagnostic error;
+        std::unique_ptr<llvm::Module> library = llvm::parseIRFile(
+            path, error, module.getContext()
+        );
+
+        if (!library) {
+            diagnostics() << path << ": " << error.getMessage().str() << std::endl;
+            return false;
+        }
+
+        // Only what the program calls is pulled in, definitions then get
+        // internalized together with the program's own functions.
+        if (llvm::Linker::linkModules(module, std::move(library), llvm::Linker::Flags::LinkOnlyNeeded)) {
+            diagnostics() << path << ": cannot be linked into the program" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool BitcodeEmitter::emit(Program const& program) {
-    auto const& externals = getModuleRegistry().getRegisteredFunctions();
-    for (FunctionPrototype const& proto: externals) {
-        GUARDED(proto.emit(this));
+    if (configHas("debug")) {
+        startDebugInfo(d, *module, program.getSource());
+    }
+
+    if (program.isStreamed()) {
+        GUARDED(program.stream([this](Emittable const& node) {
+            return node.emit(this);
+        }));
+    }
+
+    if (configHas("memoize")) {
+        d->memoized = findMemoizable(program);
     }
 
     for (Function const& function: program.getFunctions()) {
@@ -648,13 +2127,45 @@ bool BitcodeEmitter::emit(Program const& program) {
         GUARDED(program.getMain()->emit(this));
     }
 
+    emitProfileRegistration(d, *module);
+    emitProfilerRegistration(d, *module);
+
+    if (d->debug) {
+        d->debug->finalize();
+    }
+
+    GUARDED(linkLibraries(*module));
+
     verifyModule(*module);
 
+    if (optimizesPartitions(d)) {
+        // Nothing ran on the functions of this module so far.
+        d->optimizer.reset();
+        module = optimizePartitions(d, std::move(module));
+        if (!module) return false;
+    } else if (d->moduleOptimizer) {
+        d->optimizer->doFinalization();
+    }
+
+    if (d->moduleOptimizer) {
+
+        // Programs are self contained, only main needs to be visible.
+        // This lets the inliner and IPO passes work on everything else.
+        for (llvm::Function &func: *module) {
+            if (!func.isDeclaration() && func.getName() != "main") {
+                func.setLinkage(llvm::Function::InternalLinkage);
+            }
+        }
+
+        TimeReport::Phase phase("optimize-module");
+        d->moduleOptimizer->run(*module);
+    }
+
     return true;
 }
 
 bool BitcodeEmitter::emit(Id const& node) {
-    auto value = d->scope.lookup(node.getValue());
+    auto value = d->scope.lookup(node.getSymbol());
 
     if (!value) {
         return reportError(node, {
@@ -669,7 +2180,7 @@ bool BitcodeEmitter::emit(Id const& node) {
 
 bool BitcodeEmitter::emit(Integer const& node) {
     d->retval = llvm::ConstantInt::get(
-        getGlobalContext(), llvm::APInt(64, node.getValue(), true)
+        d->context, llvm::APInt(64, node.getValue(), true)
     );
 
     return true;
@@ -677,7 +2188,7 @@ bool BitcodeEmitter::emit(Integer const& node) {
 
 bool BitcodeEmitter::emit(Float const& node) {
     d->retval = llvm::ConstantFP::get(
-        getGlobalContext(), llvm::APFloat(node.getValue())
+        d->context, llvm::APFloat(node.getValue())
     );
 
     return true;
@@ -698,8 +2209,8 @@ bool BitcodeEmitter::emit(Float const& node) {
     }
 
 static
-bool createOp(BitcodeEmitter::Private *d, Localizable const& node, llvm::Value *left, Operator op, llvm::Value *right) {
-    llvm::Type *retType = deduceResultType(left, right);
+bool createOp(BitcodeEmitter::Private *d, Localizable const& node, llvm::Value *left, Operator op, llvm::Value *right, Type operands) {
+    llvm::Type *retType = LLVMType(operands, d->context);
 
     if (retType == nullptr) {
         return reportError(node, {"Cannot combine operators."});
@@ -750,6 +2261,12 @@ bool createOp(BitcodeEmitter::Private *d, Localizable const& node, llvm::Value *
             break;
     }
 
+    // The builder only flags arithmetic, comparisons are done here.
+    if (fp && d->builder.getFastMathFlags().any()) {
+        auto compare = llvm::dyn_cast<llvm::FCmpInst>(d->retval);
+        if (compare) compare->setFastMathFlags(d->builder.getFastMathFlags());
+    }
+
     return true;
 }
 
@@ -757,13 +2274,14 @@ bool createOp(BitcodeEmitter::Private *d, Localizable const& node, llvm::Value *
 #undef HANDLE_INT_ONLY
 
 bool BitcodeEmitter::emit(BinaryExpression const& expression) {
+    DebugLocation location(d, expression);
     GUARDED(expression.getLeft().emit(this));
     llvm::Value *left = d->retval;
 
     GUARDED(expression.getRight().emit(this));
     llvm::Value *right = d->retval;
 
-    GUARDED(createOp(d, expression, left, expression.getOperator(), right));
+    GUARDED(createOp(d, expression, left, expression.getOperator(), right, expression.getOperandType()));
 
     return true;
 }
@@ -775,7 +2293,7 @@ bool BitcodeEmitter::emitSemiExpression(Id const& left, SemiExpression const& ri
     GUARDED(right.getLeft().emit(this));
     llvm::Value *rhs = d->retval;
 
-    GUARDED(createOp(d, right, lhs, right.getOperator(), rhs));
+    GUARDED(createOp(d, right, lhs, right.getOperator(), rhs, right.getOperandType()));
 
     return true;
 }
@@ -783,6 +2301,7 @@ bool BitcodeEmitter::emitSemiExpression(Id const& left, SemiExpression const& ri
 bool BitcodeEmitter::ensureBasicBlock(PointerList<Statement> const& statements, llvm::BasicBlock *after) {
     d->scope.enter();
     for (Statement const& statement: statements) {
+        DebugLocation location(d, statement);
         GUARDED(statement.emit(this));
     }
     d->scope.leave();
@@ -23,8 +23,13 @@
 #include "Emitter.hpp"
 #include "Pointers.hpp"
 
+#include <ostream>
+#include <string>
+#include <vector>
+
 
 namespace llvm {
+    class LLVMContext;
     class Module;
     class Function;
     class BasicBlock;
@@ -37,7 +42,7 @@ class Statement;
 
 class BitcodeEmitter: public Emitter {
 public:
-    BitcodeEmitter();
+    explicit BitcodeEmitter(llvm::LLVMContext &context);
     BitcodeEmitter(BitcodeEmitter &) = delete;
     virtual ~BitcodeEmitter();
 
@@ -65,16 +70,55 @@ public:
         return *module;
     }
 
+    /**
+     * Compiles the module to a native object file for the configured target.
+     */
+    bool emitObject(std::ostream &out);
+
+    /**
+     * Same, but with --threads the module is split and each part compiled
+     * to an object of its own, concurrently. The emitter cannot be used
+     * anymore afterwards.
+     */
+    bool emitObjects(std::vector<std::string> &objects);
+
+    /**
+     * Hands the module over to the caller, e.g. to JIT it.
+     * The emitter cannot be used anymore afterwards.
+     */
+    Pointer<llvm::Module> takeModule();
+
     struct Private;
 
 private:
     bool emitSemiExpression(Id const& left, SemiExpression const& right);
+    bool emitConstantBranch(Branch const& node);
     bool ensureBasicBlock(PointerList<Statement> const& statements, llvm::BasicBlock *after);
 
+    /**
+     * Function already in the module, or else declared now from the module
+     * registry, the first time it is used. nullptr if unknown.
+     */
+    llvm::Function *getOrDeclare(std::string const& name);
+    /** Same, for a callee resolved by SemanticAnalyzer. */
+    llvm::Function *getOrDeclare(FunctionPrototype const& proto);
+
     Pointer<llvm::Module> module;
     Private *d;
 };
 
+/**
+ * Bitcode files linked into every program before optimizing, as requested
+ * with --link-runtime and --link-bitcode.
+ */
+std::vector<std::string> getLinkedLibraries();
+
+/**
+ * Triple, CPU and features code is generated for, with native options
+ * resolved to the host, for the cache to tell machines apart.
+ */
+std::string getTargetFingerprint();
+
 }
 
 #endif
@@ -24,6 +24,12 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <sstream>
+#include <set>
+
+#ifndef MCRT_PATH
+#define MCRT_PATH "/usr/local/lib"
+#endif
 
 namespace po = boost::program_options;
 using namespace monicelli;
@@ -46,7 +52,14 @@ po::variables_map const& monicelli::getConfig() {
     return CONFIG;
 }
 
-void monicelli::parseCommandLine(int argc, char **argv) {
+static
+void checkAssertMode(std::string const& mode) {
+    if (mode != "check" && mode != "assume" && mode != "off") {
+        throw po::validation_error(po::validation_error::invalid_option_value, "assert", mode);
+    }
+}
+
+bool monicelli::parseCommandLine(int argc, char **argv) {
     po::options_description desc(
         USAGE_STRING + argv[0] + " [options] file.mc ..."
     );
@@ -54,12 +67,50 @@ void monicelli::parseCommandLine(int argc, char **argv) {
         ("help,h", "display this help message")
         ("version,v", "display version")
         ("c++,+", "emit C++ source code instead of LLVM bitcode")
-        ("input,i", po::value<std::vector<std::string>>(), "input files to process")
+        ("c++-fast", "emit C++14 source code for optimizing compilers, using the runtime library")
+        ("object,c", "emit a native object file instead of LLVM bitcode")
+        ("exe", "emit a native executable linked against the runtime")
+        ("optimize,O", po::value<unsigned>(), "optimization level, from 0 to 3")
+        ("debug,g", "emit debug information, for debuggers and profilers like perf")
+        ("report-recursion", "warn about recursive calls which cannot be turned into loops")
+        ("stream", "parse, emit and free one function at a time, so memory depends on the largest function rather than on the source (not with --c++)")
+        ("no-simplify", "emit the program as parsed, without folding constants and removing dead code")
+        ("target", po::value<std::string>(), "target triple to generate code for (default: host)")
+        ("march", po::value<std::string>(), "architecture to generate code for, or native for the host CPU")
+        ("mcpu", po::value<std::string>(), "CPU to generate code and tune for, or native for the host one")
+        ("mattr", po::value<std::string>(), "CPU features to enable or disable, as in +avx2,-fma")
+        ("fast-math", "allow reassociating floating point operations and assuming no NaNs or infinities")
+        ("memoize", "cache the results of pure recursive functions by their arguments (bitcode only, not with --stream)")
+        ("memoize-size", po::value<unsigned>()->default_value(4096), "entries in the cache of each memoized function, rounded up to a power of two")
+        ("memoize-report", "list the functions which are memoized")
+        ("assert", po::value<std::string>()->default_value("check")->notifier(checkAssertMode), "what assertions do: check and abort if false, assume they hold when optimizing, or off (bitcode only)")
+        ("runtime-path", po::value<std::string>()->default_value(MCRT_PATH), "where to find libmcrt when linking")
+        ("link-runtime", "link the runtime bitcode (mcrt.bc) into the program, so it can be inlined")
+        ("link-bitcode", po::value<std::vector<std::string>>(), "link this bitcode file into the program, e.g. a module implementation")
+        ("profile-generate", po::value<std::string>()->implicit_value("monicelli.profile"), "count executed branches and write them to this file (default: monicelli.profile) when the program ends")
+        ("profile-use", po::value<std::string>(), "optimize for the branch counts in this profile")
+        ("profile", po::value<std::string>()->implicit_value(""), "time every function call and report on this file (default: stderr) when the program ends")
+        ("profile-loops", "with --profile, also count the iterations of each loop")
+        ("run", "JIT-compile the program and run it instead of writing output")
+        ("run-times", "with --run, report JIT setup and execution times")
+        ("threads", po::value<unsigned>(), "optimize functions and generate code in parts of the module, on this many threads; the output is the same for any number")
+        ("jobs,j", po::value<unsigned>()->default_value(1), "number of source files to compile in parallel")
+        ("time-report", po::value<std::string>()->implicit_value("text"), "report time spent in each phase, as text or json (--time-report=json)")
+        ("precompile", "write a binary .mmi index for each .mm module given, to load faster")
+        ("cache-dir", po::value<std::string>(), "reuse outputs of unchanged sources, stored in this directory")
+        ("cache-size", po::value<unsigned>()->default_value(512), "maximum size of the cache directory, in MiB")
+        ("cache-stats", "report cache hits and misses")
+        ("server", po::value<std::string>()->implicit_value(""), "stay running and compile for mcc-client, on this socket (default: $MCC_SERVER or one in /tmp)")
+        ("output,o", po::value<std::string>(), "write the output to this file, or to standard output if - (one source only)")
+        ("pipe", "compile programs read one after another from standard input, each after a line with its length in bytes, and write their outputs in the same way")
+        ("input,i", po::value<std::vector<std::string>>(), "input files to process, - for standard input")
     ;
 
     po::positional_options_description positional;
     positional.add("input", -1);
 
+    CONFIG = po::variables_map();
+
     po::store(
         po::command_line_parser(argc, argv)
             .options(desc)
@@ -72,11 +123,45 @@ void monicelli::parseCommandLine(int argc, char **argv) {
 
     if (configHas("help")) {
         std::cout << desc;
-        exit(0);
+        return false;
     }
 
     if (configHas("version")) {
         std::cout << VERSION_STRING << std::endl;
-        exit(0);
+        return false;
     }
+
+    return true;
+}
+
+// Options which never change what is written for a given input.
+static const std::set<std::string> OUTPUT_NEUTRAL_OPTIONS = {
+    "input", "jobs", "time-report", "precompile", "cache-dir", "cache-size", "cache-stats",
+    "server", "output", "pipe"
+};
+
+std::string monicelli::getConfigFingerprint() {
+    std::ostringstream fingerprint;
+    fingerprint << VERSION_STRING << '\n';
+
+    for (auto const& option: CONFIG) {
+        if (OUTPUT_NEUTRAL_OPTIONS.count(option.first)) continue;
+
+        boost::any const& value = option.second.value();
+        fingerprint << option.first << '=';
+
+        if (value.type() == typeid(unsigned)) {
+            fingerprint << boost::any_cast<unsigned>(value);
+        } else if (value.type() == typeid(std::string)) {
+            fingerprint << boost::any_cast<std::string>(value);
+        } else if (value.type() == typeid(std::vector<std::string>)) {
+            for (std::string const& item: boost::any_cast<std::vector<std::string>>(value)) {
+                fingerprint << item << ';';
+            }
+        }
+
+        fingerprint << '\n';
+    }
+
+    return fingerprint.str();
 }
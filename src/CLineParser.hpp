@@ -26,7 +26,17 @@ namespace monicelli {
 
 boost::program_options::variables_map const& getConfig();
 
-void parseCommandLine(int argc, char **argv);
+/**
+ * Returns false if the command line only asked for help or version,
+ * which have been printed already.
+ */
+bool parseCommandLine(int argc, char **argv);
+
+/**
+ * Describes the compiler version and every option which may change the
+ * output for a given input, such that equal fingerprints mean equal output.
+ */
+std::string getConfigFingerprint();
 
 template<typename T> inline
 T config(std::string const& name) {
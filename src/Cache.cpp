@@ -0,0 +1,195 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Cache.hpp"
+#include "CLineParser.hpp"
+#include "BitcodeEmitter.hpp"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+using namespace monicelli;
+namespace fs = boost::filesystem;
+
+static const std::string ENTRY_EXTENSION = ".out";
+
+struct Cache::Private {
+    fs::path directory;
+    uintmax_t capacity;
+    std::string base;
+    std::atomic<unsigned> hits;
+    std::atomic<unsigned> misses;
+};
+
+static
+void hashChunk(llvm::MD5 &hash, llvm::StringRef chunk) {
+    // The length goes first, so that chunks cannot run into each other.
+    hash.update(std::to_string(chunk.size()) + ':');
+    hash.update(chunk);
+}
+
+static
+std::string digestOf(std::string const& path) {
+    std::ifstream stream(path, std::ios::binary);
+    std::string contents(
+        (std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>()
+    );
+
+    llvm::MD5 hash;
+    hash.update(contents);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+
+    llvm::SmallString<32> digest;
+    llvm::MD5::stringifyResult(result, digest);
+    return digest.str().str();
+}
+
+// The version string stays the same across rebuilds, the binary does not.
+static
+std::string compilerDigest() {
+    static std::string const digest = digestOf(llvm::sys::fs::getMainExecutable(
+        nullptr, reinterpret_cast<void*>(&compilerDigest)
+    ));
+    return digest;
+}
+
+Cache::Cache(std::string const& directory, uintmax_t capacity) {
+    d = new Private;
+    d->directory = directory;
+    d->capacity = capacity;
+    // --march and --mcpu native depend on the machine, not on the options.
+    d->base = getConfigFingerprint() + getTargetFingerprint() + compilerDigest();
+    d->hits = 0;
+    d->misses = 0;
+
+    boost::system::error_code error;
+    fs::create_directories(d->directory, error);
+}
+
+Cache::~Cache() {
+    delete d;
+}
+
+bool Cache::addModule(std::string const& path) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.good()) return false;
+
+    std::string contents(
+        (std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>()
+    );
+
+    d->base += std::to_string(contents.size()) + ':' + contents;
+    return true;
+}
+
+std::string Cache::getKey(char const *source, size_t size, std::string const& origin) const {
+    llvm::MD5 hash;
+    hashChunk(hash, d->base);
+    hashChunk(hash, llvm::StringRef(source, size));
+    hashChunk(hash, origin);
+
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+
+    llvm::SmallString<32> key;
+    llvm::MD5::stringifyResult(result, key);
+    return key.str().str();
+}
+
+bool Cache::fetch(std::string const& key, std::string const& destination) {
+    fs::path entry = d->directory / (key + ENTRY_EXTENSION);
+    boost::system::error_code error;
+
+    fs::copy_file(entry, destination, fs::copy_option::overwrite_if_exists, error);
+
+    if (error) {
+        ++d->misses;
+        return false;
+    }
+
+    // Entries are evicted by age of last use.
+    fs::last_write_time(entry, std::time(nullptr), error);
+    ++d->hits;
+    return true;
+}
+
+void Cache::store(std::string const& key, std::string const& output) {
+    fs::path entry = d->directory / (key + ENTRY_EXTENSION);
+    fs::path partial = d->directory / fs::unique_path("%%%%-%%%%-%%%%.tmp");
+    boost::system::error_code error;
+
+    // Written aside and renamed, readers never see half an entry.
+    fs::copy_file(output, partial, fs::copy_option::overwrite_if_exists, error);
+    if (!error) fs::rename(partial, entry, error);
+    if (error) fs::remove(partial, error);
+}
+
+void Cache::evict() {
+    struct Entry {
+        fs::path path;
+        std::time_t used;
+        uintmax_t size;
+    };
+
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+    boost::system::error_code error;
+
+    for (fs::directory_iterator it(d->directory, error), end; !error && it != end; it.increment(error)) {
+        if (it->path().extension() != ENTRY_EXTENSION) continue;
+
+        Entry entry = {it->path(), fs::last_write_time(it->path(), error), fs::file_size(it->path(), error)};
+        if (error) continue;
+
+        entries.push_back(entry);
+        total += entry.size;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](Entry const& a, Entry const& b) {
+        return a.used < b.used;
+    });
+
+    for (Entry const& entry: entries) {
+        if (total <= d->capacity) break;
+        if (fs::remove(entry.path, error)) total -= entry.size;
+    }
+}
+
+void Cache::printStats(std::ostream &stream) const {
+    unsigned hits = d->hits;
+    unsigned misses = d->misses;
+    unsigned lookups = hits + misses;
+
+    stream << "Cache: " << hits << " hits, " << misses << " misses";
+    if (lookups > 0) {
+        stream << " (" << (100 * hits / lookups) << "% hit rate)";
+    }
+    stream << std::endl;
+}
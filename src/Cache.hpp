@@ -0,0 +1,67 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace monicelli {
+
+/**
+ * On-disk store of compiler outputs, addressed by a digest of everything
+ * the output depends on. Safe to share among threads and processes.
+ */
+class Cache {
+public:
+    /** The directory is created if needed, capacity is in bytes. */
+    Cache(std::string const& directory, uintmax_t capacity);
+    Cache(Cache&) = delete;
+    virtual ~Cache();
+
+    /** Contents of a loaded module, all of them come before getKey(). */
+    bool addModule(std::string const& path);
+
+    /**
+     * Key of a source, and of origin if the output depends on more than
+     * its contents, like the path and directory debug info refers to.
+     */
+    std::string getKey(char const *source, size_t size, std::string const& origin = "") const;
+
+    /** Copies the output stored under key to destination, if any. */
+    bool fetch(std::string const& key, std::string const& destination);
+
+    void store(std::string const& key, std::string const& output);
+
+    /** Removes least recently used entries until below capacity. */
+    void evict();
+
+    void printStats(std::ostream &stream) const;
+
+private:
+    struct Private;
+    Private *d;
+};
+
+}
+
+#endif
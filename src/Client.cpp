@@ -0,0 +1,42 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Server.hpp"
+
+#include <cstdio>
+#include <unistd.h>
+
+#ifndef MCC_PATH
+#define MCC_PATH "/usr/local/bin/mcc"
+#endif
+
+/*
+ * Drop-in replacement for mcc, which has a running mcc --server do the
+ * work, or else runs mcc itself.
+ */
+int main(int argc, char **argv) {
+    int status = monicelli::forwardToServer(monicelli::defaultServerSocket(), argc, argv);
+    if (status >= 0) return status;
+
+    execv(MCC_PATH, argv);
+    std::perror(MCC_PATH);
+
+    return 1;
+}
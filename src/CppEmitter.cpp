@@ -18,10 +18,17 @@
  */
 
 #include <string>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <limits>
 
 #include "Nodes.hpp"
 #include "CppEmitter.hpp"
 #include "Pointers.hpp"
+#include "Memoization.hpp"
+
+#include <set>
 
 using namespace monicelli;
 
@@ -31,6 +38,42 @@ using namespace monicelli;
 static const std::string STATEMENT_TERMINATOR = ";\n";
 static const std::string BLOCK = "    ";
 
+/** Calls to the runtime cannot be evaluated at compile time. */
+static
+bool checks(PointerList<Statement> const& statements) {
+    for (Statement const& statement: statements) {
+        if (dynamic_cast<Assert const*>(&statement) != nullptr) return true;
+
+        if (Loop const *loop = dynamic_cast<Loop const*>(&statement)) {
+            if (checks(loop->getBody())) return true;
+        } else if (Branch const *branch = dynamic_cast<Branch const*>(&statement)) {
+            for (BranchCase const& branchCase: branch->getBody().getCases()) {
+                if (checks(branchCase.getBody())) return true;
+            }
+            if (branch->getBody().getElse() && checks(*branch->getBody().getElse())) return true;
+        }
+    }
+
+    return false;
+}
+
+/** Necchi compared for equality to distinct literals only. */
+static
+bool isSwitch(Branch const& branch) {
+    if (branch.getVar().getType() != Type::INT) return false;
+
+    std::set<int64_t> seen;
+    for (BranchCase const& branchCase: branch.getBody().getCases()) {
+        SemiExpression const& condition = branchCase.getCondition();
+        if (condition.getOperator() != Operator::EQ) return false;
+
+        Integer const *value = dynamic_cast<Integer const*>(&condition.getLeft());
+        if (value == nullptr || !seen.insert(value->getValue()).second) return false;
+    }
+
+    return true;
+}
+
 
 void CppEmitter::indent() {
     indent_chars += 1;
@@ -48,7 +91,46 @@ bool CppEmitter::emitIndent() {
     return stream;
 }
 
+bool CppEmitter::emitType(Type type) {
+    if (!fast) {
+        stream << type;
+        return stream;
+    }
+
+    switch (type) {
+        case Type::INT:
+            stream << "Monicelli_Int";
+            break;
+        case Type::CHAR:
+            stream << "Monicelli_Char";
+            break;
+        case Type::FLOAT:
+            stream << "Monicelli_Float";
+            break;
+        case Type::BOOL:
+            stream << "Monicelli_Bool";
+            break;
+        case Type::DOUBLE:
+            stream << "Monicelli_Double";
+            break;
+        case Type::VOID:
+            stream << "void";
+            break;
+        case Type::UNKNOWN:
+            return false;
+    }
+
+    return stream;
+}
+
 bool CppEmitter::emit(Program const& program) {
+    if (fast) {
+        stream << "#include <monicelli/Runtime.h>\n\n";
+        constant = findPure(program, [](Function const& function) {
+            return !checks(function.getBody());
+        });
+    }
+
     for (Module m: program.getModules()) {
         GUARDED(m.emit(this));
         stream << "\n";
@@ -102,12 +184,31 @@ bool CppEmitter::emit(Id const& id) {
 }
 
 bool CppEmitter::emit(Integer const& num) {
+    // The literal 9223372036854775808 does not fit, only its negation does.
+    if (num.getValue() == std::numeric_limits<int64_t>::min()) {
+        stream << "(-9223372036854775807 - 1)";
+        return stream;
+    }
     stream << num.getValue();
     return stream;
 }
 
 bool CppEmitter::emit(Float const& num) {
-    stream << num.getValue();
+    // Shortest text that reads back as the same double, and still a
+    // floating point literal in C++.
+    std::ostringstream text;
+    for (int precision = 6; precision <= 17; ++precision) {
+        text.str("");
+        text << std::setprecision(precision) << num.getValue();
+        if (std::strtod(text.str().c_str(), nullptr) == num.getValue()) break;
+    }
+
+    std::string literal = text.str();
+    if (literal.find_first_of(".eEn") == std::string::npos) {
+        literal += ".0";
+    }
+
+    stream << literal;
     return stream;
 }
 
@@ -123,6 +224,15 @@ bool CppEmitter::emit(Return const& node) {
 }
 
 bool CppEmitter::emit(Print const& node) {
+    if (fast) {
+        if (node.getCallee() == nullptr) return false;
+        stream << node.getCallee()->getName().getValue() << '(';
+        GUARDED(node.getExpression().emit(this));
+        stream << ')';
+
+        return stream;
+    }
+
     bool needsBraces =
         (dynamic_cast<SimpleExpression const*>(&node.getExpression()) == nullptr)
             &&
@@ -131,7 +241,13 @@ bool CppEmitter::emit(Print const& node) {
 
     stream << "std::cout << ";
     if (needsBraces) {
-        stream << '(';
+        // C++ promotes operands its own way, print what bitcode would.
+        Type type = node.getExpression().getType();
+        if (type == Type::UNKNOWN) {
+            stream << '(';
+        } else {
+            stream << "static_cast<" << type << ">(";
+        }
     }
 
     GUARDED(node.getExpression().emit(this));
@@ -145,6 +261,14 @@ bool CppEmitter::emit(Print const& node) {
 }
 
 bool CppEmitter::emit(Input const& node) {
+    if (fast) {
+        if (node.getCallee() == nullptr) return false;
+        GUARDED(node.getVariable().emit(this));
+        stream << " = " << node.getCallee()->getName().getValue() << "()";
+
+        return stream;
+    }
+
     stream << "std::cout << \"";
     GUARDED(node.getVariable().emit(this));
     stream << "? \";\n";
@@ -156,13 +280,13 @@ bool CppEmitter::emit(Input const& node) {
 }
 
 bool CppEmitter::emit(Abort const&) {
-    stream << "std::exit(1)";
+    stream << (fast? "__Monicelli_abort()": "std::exit(1)");
 
     return stream;
 }
 
 bool CppEmitter::emit(Assert const& node) {
-    stream << "assert(";
+    stream << (fast? "__Monicelli_assert(": "assert(");
     GUARDED(node.getExpression().emit(this));
     stream << ")";
 
@@ -194,10 +318,51 @@ bool CppEmitter::emitBranchCase(BranchCase const& node) {
     return stream;
 }
 
+bool CppEmitter::emitSwitch(Branch const& branch) {
+    auto &body = branch.getBody();
+
+    stream << "switch (";
+    GUARDED(branch.getVar().emit(this));
+    stream << ") {\n";
+
+    for (BranchCase const& cas: body.getCases()) {
+        emitIndent();
+        stream << "case ";
+        GUARDED(cas.getCondition().getLeft().emit(this));
+        stream << ": {\n";
+        indent();
+            emitStatements(cas.getBody());
+            emitIndent();
+            stream << "break;\n";
+        dedent();
+        emitIndent();
+        stream << "}\n";
+    }
+
+    if (body.getElse()) {
+        emitIndent();
+        stream << "default: {\n";
+        indent();
+            emitStatements(*body.getElse());
+        dedent();
+        emitIndent();
+        stream << "}\n";
+    }
+
+    emitIndent();
+    stream << "}";
+
+    return stream;
+}
+
 bool CppEmitter::emit(Branch const& branch) {
     auto &body = branch.getBody();
     auto &var = branch.getVar();
 
+    if (fast && isSwitch(branch)) {
+        return emitSwitch(branch);
+    }
+
     stream << "if (";
     GUARDED(var.emit(this));
 
@@ -275,7 +440,8 @@ bool CppEmitter::emitFunctionParams(PointerList<FunArg> const& funargs) {
 
     FunArg const& last = funargs.back();
     for (FunArg const& funarg: funargs) {
-        stream << funarg.getType() << (funarg.isPointer()? "* ": " ");
+        GUARDED(emitType(funarg.getType()));
+        stream << (funarg.isPointer()? "* ": " ");
         GUARDED(funarg.getName().emit(this));
         if (&funarg != &last) {
             stream << ", ";
@@ -296,7 +462,13 @@ bool CppEmitter::emit(FunctionPrototype const& proto) {
     if (proto.getName().getValue() == "main") {
         stream << "int ";
     } else {
-        stream << proto.getType() << ' ';
+        if (fast) {
+            // Everything is in this unit, so the compiler sees all callers.
+            bool pure = constant.count(proto.getName().getSymbol());
+            stream << (pure? "static constexpr ": "static inline ");
+        }
+        GUARDED(emitType(proto.getType()));
+        stream << ' ';
     }
     GUARDED(proto.getName().emit(this));
     stream << "(";
@@ -307,13 +479,17 @@ bool CppEmitter::emit(FunctionPrototype const& proto) {
 }
 
 bool CppEmitter::emit(VarDeclaration const& decl) {
-    stream << decl.getType() << ' ';
+    GUARDED(emitType(decl.getType()));
+    stream << ' ';
     if (decl.isPointer()) stream << '*';
     GUARDED(decl.getId().emit(this));
 
     if (decl.getInitializer()) {
         stream << " = ";
         GUARDED(decl.getInitializer()->emit(this));
+    } else if (fast) {
+        // Costs nothing once optimized, and constexpr functions need it.
+        stream << " = 0";
     }
 
     return stream;
@@ -23,13 +23,20 @@
 #include "Emitter.hpp"
 
 #include <iostream>
+#include <unordered_set>
 
 
 namespace monicelli {
 
 class CppEmitter: public Emitter {
 public:
-    CppEmitter(std::ostream *stream): stream(*stream), indent_chars(0) {}
+    /**
+     * The fast flavor is for optimizing C++ compilers: functions are
+     * static inline, or constexpr where pure, types and I/O are those of
+     * the runtime, and dispatch on integer constants is a switch.
+     */
+    CppEmitter(std::ostream *stream, bool fast = false):
+        stream(*stream), indent_chars(0), fast(fast) {}
 
     virtual bool emit(Return const&) override;
     virtual bool emit(Loop const&) override;
@@ -59,12 +66,16 @@ private:
     bool emitBranchCondition(SemiExpression const& node);
     bool emitBranchCase(BranchCase const& node);
     bool emitMain(Function const& main);
+    bool emitType(Type type);
+    bool emitSwitch(Branch const& branch);
 
     void indent();
     void dedent();
 
     std::ostream &stream;
     int indent_chars;
+    bool fast;
+    std::unordered_set<Symbol> constant;
 };
 
 }
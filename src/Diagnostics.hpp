@@ -0,0 +1,41 @@
+#ifndef DIAGNOSTICS_HPP
+#define DIAGNOSTICS_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+
+namespace monicelli {
+
+/**
+ * Stream where errors for the source being compiled on the current thread
+ * should go. Defaults to std::cerr.
+ */
+std::ostream& diagnostics();
+
+/**
+ * Redirects diagnostics() for the current thread, nullptr restores std::cerr.
+ * Returns the stream used until now.
+ */
+std::ostream *setDiagnosticsStream(std::ostream *stream);
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Interner.hpp"
+
+#include <mutex>
+#include <unordered_map>
+
+using namespace monicelli;
+
+namespace {
+
+struct Table {
+    std::mutex lock;
+    std::unordered_map<std::string, size_t> entries;
+};
+
+Table& table() {
+    static Table instance;
+    return instance;
+}
+
+}
+
+Symbol monicelli::intern(std::string const& name) {
+    // Names this thread has seen before are found without taking the lock,
+    // entries of the table never move.
+    static thread_local std::unordered_map<std::string, Symbol::Entry const*> seen;
+
+    auto cached = seen.find(name);
+    if (cached != seen.end()) {
+        return Symbol(cached->second);
+    }
+
+    Table &t = table();
+    Symbol::Entry const *result;
+    {
+        std::lock_guard<std::mutex> guard(t.lock);
+
+        auto entry = t.entries.find(name);
+        if (entry == t.entries.end()) {
+            entry = t.entries.emplace(name, t.entries.size()).first;
+        }
+        result = &*entry;
+    }
+
+    seen.emplace(name, result);
+    return Symbol(result);
+}
+
+Symbol monicelli::intern(char const *name, size_t length) {
+    // The name is still copied, but into a buffer which only allocates
+    // when it has to grow.
+    static thread_local std::string key;
+    key.assign(name, length);
+    return intern(key);
+}
+
+size_t monicelli::internedCount() {
+    Table &t = table();
+    std::lock_guard<std::mutex> guard(t.lock);
+    return t.entries.size();
+}
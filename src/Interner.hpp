@@ -0,0 +1,86 @@
+#ifndef INTERNER_HPP
+#define INTERNER_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string>
+#include <functional>
+
+namespace monicelli {
+
+/**
+ * Handle to an interned string. Two symbols with the same name are the
+ * same symbol, so comparing them is a pointer compare.
+ */
+class Symbol {
+public:
+    typedef std::pair<const std::string, size_t> Entry;
+
+    /** Trivial, so that symbols fit in a %union; Symbol() is null. */
+    Symbol() = default;
+
+    std::string const& getName() const {
+        return entry->first;
+    }
+
+    /** Dense number, unique for each name interned so far. */
+    size_t getId() const {
+        return entry->second;
+    }
+
+    bool operator==(Symbol const& other) const {
+        return entry == other.entry;
+    }
+
+    bool operator!=(Symbol const& other) const {
+        return entry != other.entry;
+    }
+
+private:
+    explicit Symbol(Entry const *e): entry(e) {}
+
+    Entry const *entry;
+
+    friend Symbol intern(std::string const& name);
+    friend Symbol intern(char const *name, size_t length);
+};
+
+/** Symbols live until the program exits and can be shared by threads. */
+Symbol intern(std::string const& name);
+Symbol intern(char const *name, size_t length);
+
+/** Number of distinct symbols interned so far. */
+size_t internedCount();
+
+}
+
+namespace std {
+
+template<>
+struct hash<monicelli::Symbol> {
+    size_t operator()(monicelli::Symbol const& symbol) const {
+        return std::hash<size_t>()(symbol.getId());
+    }
+};
+
+}
+
+#endif
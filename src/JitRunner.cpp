@@ -0,0 +1,177 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "JitRunner.hpp"
+#include "Diagnostics.hpp"
+#include "Runtime.h"
+
+#include <llvm/IR/Module.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+
+using namespace monicelli;
+
+#define SYMBOL(name) {#name, reinterpret_cast<void*>(&name)}
+
+static const std::map<std::string, void*> RUNTIME_SYMBOLS = {
+    SYMBOL(__Monicelli_putBool),
+    SYMBOL(__Monicelli_putChar),
+    SYMBOL(__Monicelli_putInt),
+    SYMBOL(__Monicelli_putFloat),
+    SYMBOL(__Monicelli_putDouble),
+    SYMBOL(__Monicelli_getBool),
+    SYMBOL(__Monicelli_getChar),
+    SYMBOL(__Monicelli_getInt),
+    SYMBOL(__Monicelli_getFloat),
+    SYMBOL(__Monicelli_getDouble),
+    SYMBOL(__Monicelli_abort),
+    SYMBOL(__Monicelli_assert),
+    SYMBOL(__Monicelli_profileInit),
+    SYMBOL(__Monicelli_profileWrite),
+    SYMBOL(__Monicelli_profilerStart),
+    SYMBOL(__Monicelli_profilerEnter),
+    SYMBOL(__Monicelli_profilerExit),
+    SYMBOL(__Monicelli_profilerReport)
+};
+
+#undef SYMBOL
+
+static std::once_flag jitInitialized;
+
+static
+void initializeJit() {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    for (auto const& symbol: RUNTIME_SYMBOLS) {
+        llvm::sys::DynamicLibrary::AddSymbol(symbol.first, symbol.second);
+    }
+}
+
+static std::mutex librariesLock;
+static std::map<std::string, llvm::sys::DynamicLibrary> libraries;
+
+bool monicelli::loadLibrary(std::string const& path) {
+    std::lock_guard<std::mutex> guard(librariesLock);
+    if (libraries.count(path)) return true;
+
+    std::string error;
+    llvm::sys::DynamicLibrary library = llvm::sys::DynamicLibrary::getPermanentLibrary(path.c_str(), &error);
+
+    if (!library.isValid()) {
+        diagnostics() << path << ": cannot load library: " << error << std::endl;
+        return false;
+    }
+
+    libraries.insert({path, library});
+    return true;
+}
+
+/**
+ * Binds the functions the module only declares to their code in the
+ * libraries, so that they are not searched for in the whole process.
+ */
+static
+void bindLibraries(llvm::ExecutionEngine &engine, llvm::Module &module, std::vector<std::string> const& paths) {
+    std::lock_guard<std::mutex> guard(librariesLock);
+
+    for (llvm::Function &func: module) {
+        if (!func.isDeclaration() || func.isIntrinsic()) continue;
+
+        std::string name = func.getName().str();
+        for (std::string const& path: paths) {
+            void *address = libraries.at(path).getAddressOfSymbol(name.c_str());
+            if (address != nullptr) {
+                engine.addGlobalMapping(&func, address);
+                break;
+            }
+        }
+    }
+}
+
+static inline
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+bool monicelli::runModule(Pointer<llvm::Module> module, std::vector<std::string> const& libraries, bool reportTimes) {
+    auto setupStart = std::chrono::steady_clock::now();
+
+    std::call_once(jitInitialized, initializeJit);
+
+    for (std::string const& path: libraries) {
+        if (!loadLibrary(path)) return false;
+    }
+
+    llvm::Module &program = *module;
+
+    std::string error;
+    Pointer<llvm::ExecutionEngine> engine(
+        llvm::EngineBuilder(std::move(module))
+            .setErrorStr(&error)
+            .setEngineKind(llvm::EngineKind::JIT)
+            .setMCJITMemoryManager(Pointer<llvm::RTDyldMemoryManager>(
+                new llvm::SectionMemoryManager()
+            ))
+            .create()
+    );
+
+    if (!engine) {
+        diagnostics() << "Cannot create JIT: " << error << std::endl;
+        return false;
+    }
+
+    bindLibraries(*engine, program, libraries);
+
+    engine->finalizeObject();
+
+    uint64_t address = engine->getFunctionAddress("main");
+
+    if (address == 0) {
+        diagnostics() << "Program has no main to run" << std::endl;
+        return false;
+    }
+
+    double setupTime = millisecondsSince(setupStart);
+    auto runStart = std::chrono::steady_clock::now();
+
+    reinterpret_cast<void(*)()>(address)();
+
+    double runTime = millisecondsSince(runStart);
+
+    if (reportTimes) {
+        std::fflush(stdout);
+        std::cerr << "JIT setup: " << setupTime << " ms, ";
+        std::cerr << "execution: " << runTime << " ms" << std::endl;
+    }
+
+    return true;
+}
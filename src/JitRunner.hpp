@@ -0,0 +1,51 @@
+#ifndef JIT_RUNNER_HPP
+#define JIT_RUNNER_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Pointers.hpp"
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+    class Module;
+}
+
+namespace monicelli {
+
+/**
+ * Opens a shared object with the code of module functions, only the first
+ * time in the process. Reports and returns false if it cannot be opened.
+ */
+bool loadLibrary(std::string const& path);
+
+/**
+ * JIT-compiles the module and calls its main() in process. The Monicelli
+ * runtime is linked into mcc, so __Monicelli_* calls resolve to it. Other
+ * functions are looked up in the libraries first, in order.
+ *
+ * If reportTimes is set, JIT setup and execution times go to stderr.
+ */
+bool runModule(Pointer<llvm::Module> module, std::vector<std::string> const& libraries, bool reportTimes);
+
+}
+
+#endif
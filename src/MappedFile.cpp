@@ -0,0 +1,89 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "MappedFile.hpp"
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <iterator>
+
+using namespace monicelli;
+namespace ipc = boost::interprocess;
+
+struct MappedFile::Private {
+    ipc::file_mapping file;
+    ipc::mapped_region region;
+    // Read rather than mapped.
+    std::string contents;
+};
+
+MappedFile::MappedFile(): data(nullptr), size(0) {}
+
+MappedFile::~MappedFile() {}
+
+bool MappedFile::open(std::string const& path) {
+    boost::system::error_code error;
+    uintmax_t length = boost::filesystem::file_size(path, error);
+
+    if (error) return false;
+
+    // Empty files cannot be mapped, but there is nothing to read anyway.
+    if (length == 0) {
+        d.reset();
+        data = "";
+        size = 0;
+        return true;
+    }
+
+    try {
+        Pointer<Private> mapping(new Private);
+        mapping->file = ipc::file_mapping(path.c_str(), ipc::read_only);
+        mapping->region = ipc::mapped_region(mapping->file, ipc::read_only);
+
+        data = static_cast<char const*>(mapping->region.get_address());
+        size = mapping->region.get_size();
+        d = std::move(mapping);
+    } catch (ipc::interprocess_exception const&) {
+        return false;
+    }
+
+    return true;
+}
+
+bool MappedFile::read(std::istream &in, size_t length) {
+    Pointer<Private> buffer(new Private);
+
+    if (length == std::string::npos) {
+        buffer->contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        if (in.bad()) return false;
+    } else {
+        buffer->contents.resize(length);
+        in.read(&buffer->contents[0], length);
+        if (static_cast<size_t>(in.gcount()) != length) return false;
+    }
+
+    data = buffer->contents.data();
+    size = buffer->contents.size();
+    d = std::move(buffer);
+
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Pointers.hpp"
+
+#include <istream>
+#include <string>
+
+namespace monicelli {
+
+/**
+ * Read-only view of a whole file, mapped in memory instead of read.
+ * Sources which are not files, like standard input, are read after all.
+ */
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    /** Returns false if the file cannot be opened or mapped. */
+    bool open(std::string const& path);
+
+    /**
+     * Reads length bytes of a stream into memory instead, or all of it if
+     * length is npos. Returns false if the stream ends before.
+     */
+    bool read(std::istream &in, size_t length = std::string::npos);
+
+    char const *getData() const {
+        return data;
+    }
+
+    size_t getSize() const {
+        return size;
+    }
+
+private:
+    struct Private;
+    Pointer<Private> d;
+    char const *data;
+    size_t size;
+};
+
+}
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Memoization.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+using namespace monicelli;
+
+namespace {
+
+typedef std::unordered_map<FunctionPrototype const*, Function const*> Functions;
+
+/** What a function calls, and whether it may have effects of its own. */
+struct Summary {
+    bool impure = false;
+    std::vector<Function const*> callees;
+};
+
+class Summarizer {
+public:
+    Summarizer(Functions const& functions, Summary &summary):
+        functions(functions), summary(summary) {}
+
+    void visit(PointerList<Statement> const& statements);
+    void visit(Statement const& statement);
+    void visit(Expression const& expression);
+    void visit(FunctionCall const& call);
+
+private:
+    Functions const& functions;
+    Summary &summary;
+};
+
+void Summarizer::visit(PointerList<Statement> const& statements) {
+    for (Statement const& statement: statements) {
+        visit(statement);
+    }
+}
+
+void Summarizer::visit(Statement const& statement) {
+    if (dynamic_cast<Print const*>(&statement) != nullptr ||
+        dynamic_cast<Input const*>(&statement) != nullptr ||
+        dynamic_cast<Abort const*>(&statement) != nullptr) {
+        summary.impure = true;
+    } else if (Return const *node = dynamic_cast<Return const*>(&statement)) {
+        if (node->getExpression()) visit(*node->getExpression());
+    } else if (Loop const *node = dynamic_cast<Loop const*>(&statement)) {
+        visit(node->getBody());
+        visit(node->getCondition());
+    } else if (VarDeclaration const *node = dynamic_cast<VarDeclaration const*>(&statement)) {
+        if (node->getInitializer()) visit(*node->getInitializer());
+    } else if (Assignment const *node = dynamic_cast<Assignment const*>(&statement)) {
+        visit(node->getValue());
+    } else if (Assert const *node = dynamic_cast<Assert const*>(&statement)) {
+        visit(node->getExpression());
+    } else if (FunctionCall const *node = dynamic_cast<FunctionCall const*>(&statement)) {
+        visit(*node);
+    } else if (Branch const *node = dynamic_cast<Branch const*>(&statement)) {
+        for (BranchCase const& branchCase: node->getBody().getCases()) {
+            visit(branchCase.getCondition().getLeft());
+            visit(branchCase.getBody());
+        }
+        if (node->getBody().getElse()) {
+            visit(*node->getBody().getElse());
+        }
+    }
+}
+
+void Summarizer::visit(Expression const& expression) {
+    if (FunctionCall const *node = dynamic_cast<FunctionCall const*>(&expression)) {
+        visit(*node);
+    } else if (BinaryExpression const *node = dynamic_cast<BinaryExpression const*>(&expression)) {
+        visit(node->getLeft());
+        visit(node->getRight());
+    }
+}
+
+void Summarizer::visit(FunctionCall const& call) {
+    // External functions, from modules, may do anything.
+    auto callee = functions.find(call.getCallee());
+    if (callee == functions.end()) {
+        summary.impure = true;
+    } else {
+        summary.callees.push_back(callee->second);
+    }
+
+    for (Expression const& arg: call.getArgs()) {
+        visit(arg);
+    }
+}
+
+bool isIntegral(Type type) {
+    return type == Type::INT || type == Type::CHAR || type == Type::BOOL;
+}
+
+bool hasCacheableSignature(FunctionPrototype const& prototype) {
+    if (prototype.getType() == Type::VOID || prototype.getType() == Type::UNKNOWN) {
+        return false;
+    }
+
+    if (prototype.getArgs().empty()) return false;
+
+    for (FunArg const& arg: prototype.getArgs()) {
+        if (arg.isPointer() || !isIntegral(arg.getType())) return false;
+    }
+
+    return true;
+}
+
+typedef std::unordered_map<Function const*, Summary> Summaries;
+
+bool reaches(Summaries const& summaries, Function const *from, Function const *to,
+        std::unordered_set<Function const*> &seen) {
+    for (Function const *callee: summaries.at(from).callees) {
+        if (callee == to) return true;
+        if (seen.insert(callee).second && reaches(summaries, callee, to, seen)) return true;
+    }
+
+    return false;
+}
+
+Summaries summarize(Program const& program, std::function<bool(Function const&)> const& eligible) {
+    Functions functions;
+    for (Function const& function: program.getFunctions()) {
+        functions[&function.getPrototype()] = &function;
+    }
+
+    Summaries summaries;
+    for (Function const& function: program.getFunctions()) {
+        Summary &summary = summaries[&function];
+        Summarizer(functions, summary).visit(function.getBody());
+        if (eligible && !eligible(function)) summary.impure = true;
+    }
+
+    // Functions are pure unless they have effects or call one which does,
+    // so that mutually recursive functions can be pure too.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto &entry: summaries) {
+            if (entry.second.impure) continue;
+            for (Function const *callee: entry.second.callees) {
+                if (summaries.at(callee).impure) {
+                    entry.second.impure = true;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    return summaries;
+}
+
+}
+
+std::unordered_set<Symbol> monicelli::findPure(
+    Program const& program, std::function<bool(Function const&)> const& eligible) {
+    std::unordered_set<Symbol> pure;
+    for (auto const& entry: summarize(program, eligible)) {
+        if (!entry.second.impure) {
+            pure.insert(entry.first->getPrototype().getName().getSymbol());
+        }
+    }
+
+    return pure;
+}
+
+std::unordered_set<Symbol> monicelli::findMemoizable(Program const& program) {
+    Summaries summaries = summarize(program, nullptr);
+
+    std::unordered_set<Symbol> memoizable;
+    for (Function const& function: program.getFunctions()) {
+        if (summaries.at(&function).impure) continue;
+        if (!hasCacheableSignature(function.getPrototype())) continue;
+
+        std::unordered_set<Function const*> seen;
+        if (reaches(summaries, &function, &function, seen)) {
+            memoizable.insert(function.getPrototype().getName().getSymbol());
+        }
+    }
+
+    return memoizable;
+}
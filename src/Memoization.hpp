@@ -0,0 +1,51 @@
+#ifndef MEMOIZATION_HPP
+#define MEMOIZATION_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Nodes.hpp"
+
+#include <functional>
+#include <unordered_set>
+
+namespace monicelli {
+
+/**
+ * Functions of the program which only compute a value from their
+ * arguments: they do no input or output, do not abort, and only call such
+ * functions of the program itself. Those which are not eligible do not
+ * count as pure, nor do their callers. Callees must have been resolved by
+ * SemanticAnalyzer.
+ */
+std::unordered_set<Symbol> findPure(
+    Program const& program,
+    std::function<bool(Function const&)> const& eligible = nullptr
+);
+
+/**
+ * Pure functions of the program whose results are worth caching by their
+ * arguments: they are recursive, return a value and take only integers.
+ */
+std::unordered_set<Symbol> findMemoizable(Program const& program);
+
+}
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ModuleIndex.hpp"
+#include "MappedFile.hpp"
+#include "Nodes.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace monicelli;
+
+static const char INDEX_MAGIC[4] = {'M', 'M', 'I', '\x02'};
+
+namespace {
+
+struct IndexHeader {
+    char magic[4];
+    uint32_t functions;
+    uint32_t arguments;
+    uint32_t libraries;
+    uint32_t namesSize;
+};
+
+struct NameRef {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct FunctionEntry {
+    NameRef name;
+    uint32_t firstArg;
+    uint16_t argCount;
+    uint8_t type;
+    uint8_t padding;
+};
+
+struct ArgumentEntry {
+    NameRef name;
+    uint8_t type;
+    uint8_t padding[3];
+};
+
+}
+
+struct ModuleIndex::Private {
+    MappedFile file;
+    IndexHeader const *header;
+    FunctionEntry const *functions;
+    ArgumentEntry const *arguments;
+    NameRef const *libraries;
+    char const *names;
+
+    std::string getName(NameRef ref) const {
+        return std::string(names + ref.offset, ref.length);
+    }
+
+    bool isValid(NameRef ref) const {
+        return ref.offset <= header->namesSize
+            && ref.length <= header->namesSize - ref.offset;
+    }
+
+    bool isValid(uint8_t type) const {
+        return type <= static_cast<uint8_t>(Type::UNKNOWN);
+    }
+};
+
+ModuleIndex::ModuleIndex() {
+    d = new Private;
+    d->header = nullptr;
+}
+
+ModuleIndex::~ModuleIndex() {
+    delete d;
+}
+
+bool ModuleIndex::open(std::string const& path) {
+    if (!d->file.open(path)) return false;
+
+    char const *data = d->file.getData();
+    size_t size = d->file.getSize();
+
+    if (size < sizeof(IndexHeader)) return false;
+
+    IndexHeader const *header = reinterpret_cast<IndexHeader const*>(data);
+    if (std::memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+        return false;
+    }
+
+    uint64_t expected = sizeof(IndexHeader)
+        + uint64_t(header->functions) * sizeof(FunctionEntry)
+        + uint64_t(header->arguments) * sizeof(ArgumentEntry)
+        + uint64_t(header->libraries) * sizeof(NameRef)
+        + header->namesSize;
+
+    if (expected != size) return false;
+
+    d->header = header;
+    d->functions = reinterpret_cast<FunctionEntry const*>(data + sizeof(IndexHeader));
+    d->arguments = reinterpret_cast<ArgumentEntry const*>(d->functions + d->header->functions);
+    d->libraries = reinterpret_cast<NameRef const*>(d->arguments + d->header->arguments);
+    d->names = reinterpret_cast<char const*>(d->libraries + d->header->libraries);
+
+    return true;
+}
+
+size_t ModuleIndex::getSize() const {
+    return d->header != nullptr? d->header->functions: 0;
+}
+
+std::vector<std::string> ModuleIndex::getLibraries() const {
+    std::vector<std::string> libraries;
+    if (d->header == nullptr) return libraries;
+
+    for (uint32_t i = 0; i < d->header->libraries; ++i) {
+        if (d->isValid(d->libraries[i])) {
+            libraries.push_back(d->getName(d->libraries[i]));
+        }
+    }
+
+    return libraries;
+}
+
+FunctionPrototype *ModuleIndex::find(std::string const& name) const {
+    if (d->header == nullptr) return nullptr;
+
+    FunctionEntry const *begin = d->functions;
+    FunctionEntry const *end = d->functions + d->header->functions;
+
+    FunctionEntry const *entry = std::lower_bound(begin, end, name,
+        [this](FunctionEntry const& e, std::string const& key) {
+            return d->isValid(e.name) &&
+                key.compare(0, std::string::npos, d->names + e.name.offset, e.name.length) > 0;
+        }
+    );
+
+    if (entry == end || !d->isValid(entry->name) || d->getName(entry->name) != name) {
+        return nullptr;
+    }
+
+    if (uint64_t(entry->firstArg) + entry->argCount > d->header->arguments) return nullptr;
+    if (!d->isValid(entry->type)) return nullptr;
+
+    PointerList<FunArg> *args = new PointerList<FunArg>();
+    for (uint32_t i = entry->firstArg; i < entry->firstArg + entry->argCount; ++i) {
+        ArgumentEntry const& arg = d->arguments[i];
+
+        if (!d->isValid(arg.name) || !d->isValid(arg.type)) {
+            delete args;
+            return nullptr;
+        }
+
+        args->push_back(new FunArg(
+            new Id(d->getName(arg.name)), static_cast<Type>(arg.type), false
+        ));
+    }
+
+    return new FunctionPrototype(
+        new Id(name), static_cast<Type>(entry->type), args
+    );
+}
+
+bool monicelli::writeModuleIndex(PointerSet<FunctionPrototype> const& functions,
+                                 std::vector<std::string> const& libraries, std::ostream &out) {
+    std::vector<FunctionPrototype const*> sorted;
+    for (FunctionPrototype const& proto: functions) {
+        sorted.push_back(&proto);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](FunctionPrototype const *a, FunctionPrototype const *b) {
+        return a->getName().getValue() < b->getName().getValue();
+    });
+
+    std::vector<FunctionEntry> functionEntries;
+    std::vector<ArgumentEntry> argumentEntries;
+    std::string names;
+
+    auto addName = [&names](std::string const& name) {
+        NameRef ref = {uint32_t(names.size()), uint32_t(name.size())};
+        names += name;
+        return ref;
+    };
+
+    for (FunctionPrototype const *proto: sorted) {
+        FunctionEntry entry = {};
+        entry.name = addName(proto->getName().getValue());
+        entry.firstArg = argumentEntries.size();
+        entry.argCount = proto->getArgs().size();
+        entry.type = static_cast<uint8_t>(proto->getType());
+
+        for (FunArg const& arg: proto->getArgs()) {
+            ArgumentEntry argument = {};
+            argument.name = addName(arg.getName().getValue());
+            argument.type = static_cast<uint8_t>(arg.getType());
+            argumentEntries.push_back(argument);
+        }
+
+        functionEntries.push_back(entry);
+    }
+
+    std::vector<NameRef> libraryEntries;
+    for (std::string const& library: libraries) {
+        libraryEntries.push_back(addName(library));
+    }
+
+    IndexHeader header = {};
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.functions = functionEntries.size();
+    header.arguments = argumentEntries.size();
+    header.libraries = libraryEntries.size();
+    header.namesSize = names.size();
+
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    out.write(reinterpret_cast<char const*>(functionEntries.data()), functionEntries.size() * sizeof(FunctionEntry));
+    out.write(reinterpret_cast<char const*>(argumentEntries.data()), argumentEntries.size() * sizeof(ArgumentEntry));
+    out.write(reinterpret_cast<char const*>(libraryEntries.data()), libraryEntries.size() * sizeof(NameRef));
+    out.write(names.data(), names.size());
+
+    return out.good();
+}
@@ -0,0 +1,70 @@
+#ifndef MODULE_INDEX_HPP
+#define MODULE_INDEX_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Pointers.hpp"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace monicelli {
+
+class FunctionPrototype;
+
+/**
+ * Precompiled, memory mapped form of a .mm module. Prototypes are sorted
+ * by name and only turned into nodes when looked up.
+ *
+ * The file is a header, a table of fixed size records, one for each
+ * function, then all of the arguments and the libraries of the module,
+ * followed by the names. All integers are in host byte order, indices
+ * are not portable.
+ */
+class ModuleIndex {
+public:
+    ModuleIndex();
+    ModuleIndex(ModuleIndex&) = delete;
+    virtual ~ModuleIndex();
+
+    /** Returns false if the file cannot be mapped or is not an index. */
+    bool open(std::string const& path);
+
+    /** New prototype owned by the caller, nullptr if name is not there. */
+    FunctionPrototype *find(std::string const& name) const;
+
+    size_t getSize() const;
+
+    /** Shared objects implementing the functions, as in the .mm module. */
+    std::vector<std::string> getLibraries() const;
+
+private:
+    struct Private;
+    Private *d;
+};
+
+bool writeModuleIndex(PointerSet<FunctionPrototype> const& functions,
+                      std::vector<std::string> const& libraries, std::ostream &out);
+
+}
+
+#endif
@@ -1,8 +1,11 @@
 #include "Nodes.hpp"
 #include "ModuleRegistry.hpp"
 #include "ModuleLoader.hpp"
+#include "ModuleIndex.hpp"
 
 #include <yaml-cpp/yaml.h>
+#include <boost/filesystem.hpp>
+#include <fstream>
 #include <string>
 
 using namespace monicelli;
@@ -25,9 +28,34 @@ Type toType(std::string const& value) {
     }
 }
 
+/**
+ * Paths are relative to the module, names which are not found there are
+ * left to the dynamic linker, as in library: libm.so.6.
+ */
+static
+std::string libraryPath(std::string const& module, std::string const& library) {
+    namespace fs = boost::filesystem;
+
+    fs::path path(library);
+    if (path.is_absolute()) return library;
+
+    fs::path local = fs::absolute(path, fs::absolute(module).parent_path());
+    return fs::exists(local)? local.native(): library;
+}
+
 void monicelli::loadModule(std::string const& from, ModuleRegistry &to) {
     YAML::Node module  = YAML::LoadFile(from);
 
+    if (YAML::Node library = module["library"]) {
+        if (library.IsSequence()) {
+            for (auto const& item: library) {
+                to.registerLibrary(libraryPath(from, item.as<std::string>()));
+            }
+        } else {
+            to.registerLibrary(libraryPath(from, library.as<std::string>()));
+        }
+    }
+
     if (!module["functions"]) return;
 
     for (auto const& proto: module["functions"]) {
@@ -53,3 +81,26 @@ void monicelli::loadModule(std::string const& from, ModuleRegistry &to) {
     }
 }
 
+bool monicelli::loadModuleIndex(std::string const& from, ModuleRegistry &to) {
+    ModuleIndex *index = new ModuleIndex();
+
+    if (!index->open(from)) {
+        delete index;
+        return false;
+    }
+
+    for (std::string const& library: index->getLibraries()) {
+        to.registerLibrary(library);
+    }
+
+    to.registerIndex(index);
+    return true;
+}
+
+bool monicelli::precompileModule(std::string const& from, std::string const& to) {
+    ModuleRegistry module;
+    loadModule(from, module);
+
+    std::ofstream out(to, std::ios::binary);
+    return writeModuleIndex(module.getRegisteredFunctions(), module.getLibraries(), out);
+}
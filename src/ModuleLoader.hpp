@@ -5,6 +5,12 @@ namespace monicelli {
 
 void loadModule(std::string const& from, monicelli::ModuleRegistry &to);
 
+/** Registers a precompiled .mmi index, returns false if it is not valid. */
+bool loadModuleIndex(std::string const& from, monicelli::ModuleRegistry &to);
+
+/** Writes the .mmi index of the .mm module in from. */
+bool precompileModule(std::string const& from, std::string const& to);
+
 }
 
 #endif
@@ -18,20 +18,38 @@
  */
 
 #include "ModuleRegistry.hpp"
+#include "ModuleIndex.hpp"
 #include "Pointers.hpp"
 #include "Nodes.hpp"
 
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 
 using namespace monicelli;
 
 static ModuleRegistry globalRegistry;
+static ModuleRegistry *currentRegistry = &globalRegistry;
 
 ModuleRegistry& monicelli::getModuleRegistry() {
-    return globalRegistry;
+    return *currentRegistry;
+}
+
+ModuleRegistry* monicelli::setModuleRegistry(ModuleRegistry *registry) {
+    ModuleRegistry *previous = currentRegistry;
+    currentRegistry = registry;
+    return previous;
 }
 
 struct ModuleRegistry::Private {
     boost::ptr_unordered_set<FunctionPrototype> prototypes;
+    std::unordered_map<Symbol, FunctionPrototype const*> byName;
+    PointerList<ModuleIndex> indices;
+    std::vector<ModuleRegistry*> imports;
+    std::vector<std::string> libraries;
+    std::mutex lock;
 };
 
 ModuleRegistry::ModuleRegistry() {
@@ -47,7 +65,74 @@ PointerSet<FunctionPrototype> const& ModuleRegistry::getRegisteredFunctions() co
 }
 
 void ModuleRegistry::registerFunction(FunctionPrototype *proto) {
-    d->prototypes.insert(proto);
+    Symbol name = proto->getName().getSymbol();
+    auto inserted = d->prototypes.insert(proto);
+
+    if (inserted.second) {
+        d->byName[name] = &*inserted.first;
+    } else {
+        delete proto;
+    }
+}
+
+void ModuleRegistry::registerIndex(ModuleIndex *index) {
+    d->indices.push_back(index);
+}
+
+void ModuleRegistry::registerLibrary(std::string const& path) {
+    if (std::find(d->libraries.begin(), d->libraries.end(), path) == d->libraries.end()) {
+        d->libraries.push_back(path);
+    }
+}
+
+std::vector<std::string> ModuleRegistry::getLibraries() const {
+    std::vector<std::string> libraries = d->libraries;
+
+    for (ModuleRegistry const *other: d->imports) {
+        for (std::string const& path: other->getLibraries()) {
+            if (std::find(libraries.begin(), libraries.end(), path) == libraries.end()) {
+                libraries.push_back(path);
+            }
+        }
+    }
+
+    return libraries;
+}
+
+void ModuleRegistry::import(ModuleRegistry &other) {
+    d->imports.push_back(&other);
+}
+
+FunctionPrototype const* ModuleRegistry::lookup(Symbol name) {
+    std::lock_guard<std::mutex> guard(d->lock);
+
+    auto known = d->byName.find(name);
+    if (known != d->byName.end()) return known->second;
+
+    // The registry outlives the program being compiled, keep the
+    // prototype out of its arena.
+    Arena *arena = Arena::setCurrent(nullptr);
+    FunctionPrototype *proto = nullptr;
+    for (ModuleIndex const& index: d->indices) {
+        proto = index.find(name.getName());
+        if (proto != nullptr) break;
+    }
+    Arena::setCurrent(arena);
+
+    if (proto != nullptr) {
+        registerFunction(proto);
+        return d->byName[name];
+    }
+
+    for (ModuleRegistry *other: d->imports) {
+        FunctionPrototype const *imported = other->lookup(name);
+        if (imported != nullptr) {
+            d->byName[name] = imported;
+            return imported;
+        }
+    }
+
+    return nullptr;
 }
 
 #define PUT(type, funcname) \
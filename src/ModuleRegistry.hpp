@@ -21,10 +21,15 @@
  */
 
 #include "Pointers.hpp"
+#include "Interner.hpp"
+
+#include <string>
+#include <vector>
 
 namespace monicelli {
 
 class FunctionPrototype;
+class ModuleIndex;
 
 class ModuleRegistry {
 public:
@@ -33,14 +38,40 @@ public:
     virtual ~ModuleRegistry();
 
     PointerSet<FunctionPrototype> const& getRegisteredFunctions() const;
+    /** Takes ownership, the first prototype registered for a name wins. */
     void registerFunction(FunctionPrototype *proto);
 
+    /** Takes ownership, prototypes are only read from it when needed. */
+    void registerIndex(ModuleIndex *index);
+
+    /** Shared object with the code of registered functions, for the JIT. */
+    void registerLibrary(std::string const& path);
+
+    /** Libraries of this registry, then those of the imported ones. */
+    std::vector<std::string> getLibraries() const;
+
+    /**
+     * Also look up prototypes in the other registry, after this one's own.
+     * Does not take ownership, the other registry must outlive this one.
+     */
+    void import(ModuleRegistry &other);
+
+    /**
+     * Prototype of the external function with that name, also looking in
+     * registered indices, or nullptr. Safe to call from several threads.
+     */
+    FunctionPrototype const* lookup(Symbol name);
+
 private:
     struct Private;
     Private *d;
 };
 
 ModuleRegistry& getModuleRegistry();
+
+/** Makes the registry the one returned by getModuleRegistry(), returns the previous one. */
+ModuleRegistry* setModuleRegistry(ModuleRegistry *registry);
+
 void registerStdLib(ModuleRegistry &);
 
 }
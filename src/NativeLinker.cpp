@@ -0,0 +1,96 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "NativeLinker.hpp"
+#include "CLineParser.hpp"
+#include "Diagnostics.hpp"
+
+#include <boost/filesystem.hpp>
+
+#include <cstdlib>
+#include <fstream>
+
+using namespace monicelli;
+namespace fs = boost::filesystem;
+
+static
+std::string quote(std::string const& arg) {
+    std::string result = "'";
+    for (char c: arg) {
+        if (c == '\'') {
+            result += "'\\''";
+        } else {
+            result += c;
+        }
+    }
+    return result + "'";
+}
+
+static
+std::string tool(char const *variable, char const *fallback) {
+    char const *value = std::getenv(variable);
+    return quote(value != nullptr? value: fallback);
+}
+
+/** Runs command, which writes output, and then copies that to out. */
+static
+bool runLinker(std::string const& command, fs::path const& output, std::ostream &out) {
+    if (std::system(command.c_str()) != 0) {
+        diagnostics() << "Linking failed: " << command << std::endl;
+        fs::remove(output);
+        return false;
+    }
+
+    std::ifstream linked(output.native(), std::ios::binary);
+    out << linked.rdbuf();
+    linked.close();
+
+    fs::remove(output);
+
+    return static_cast<bool>(out);
+}
+
+bool monicelli::linkExecutable(std::vector<std::string> const& objects, std::ostream &out) {
+    fs::path executable = fs::temp_directory_path() / fs::unique_path("mcc-%%%%-%%%%-%%%%");
+
+    std::string command = tool("CC", "cc");
+    for (std::string const& object: objects) {
+        command += ' ' + quote(object);
+    }
+    command += " -L" + quote(config<std::string>("runtime-path"));
+    command += " -lmcrt -o " + quote(executable.native());
+
+    return runLinker(command, executable, out);
+}
+
+bool monicelli::linkRelocatable(std::vector<std::string> const& objects, std::ostream &out) {
+    fs::path object = fs::temp_directory_path() / fs::unique_path("mcc-%%%%-%%%%-%%%%.o");
+
+    std::string command = tool("CC", "cc") + " -r -nostdlib";
+    for (std::string const& input: objects) {
+        command += ' ' + quote(input);
+    }
+    command += " -o " + quote(object.native());
+
+    // The parts see each other's locals as hidden symbols, which must not
+    // clash with those of other objects.
+    command += " && " + tool("OBJCOPY", "objcopy") + " --localize-hidden " + quote(object.native());
+
+    return runLinker(command, object, out);
+}
@@ -0,0 +1,43 @@
+#ifndef NATIVE_LINKER_HPP
+#define NATIVE_LINKER_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace monicelli {
+
+/**
+ * Links the given object files and the Monicelli runtime into an
+ * executable, which is then copied to out.
+ */
+bool linkExecutable(std::vector<std::string> const& objects, std::ostream &out);
+
+/**
+ * Links the given object files into a single one, which is then copied to
+ * out. Hidden symbols become local to it.
+ */
+bool linkRelocatable(std::vector<std::string> const& objects, std::ostream &out);
+
+}
+
+#endif
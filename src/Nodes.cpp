@@ -19,9 +19,44 @@
 
 #include "Nodes.hpp"
 #include <string>
+#include <new>
 
 using namespace monicelli;
 
+namespace {
+
+/**
+ * Stored right before each node, so that delete knows whether the memory
+ * came from an arena.
+ */
+union NodeHeader {
+    Arena *arena;
+    std::max_align_t alignment;
+};
+
+}
+
+void *Localizable::operator new(size_t size) {
+    Arena *arena = Arena::current();
+    size += sizeof(NodeHeader);
+
+    NodeHeader *header = static_cast<NodeHeader*>(
+        arena != nullptr? arena->allocate(size): ::operator new(size)
+    );
+    header->arena = arena;
+
+    return header + 1;
+}
+
+void Localizable::operator delete(void *node) {
+    if (node == nullptr) return;
+
+    NodeHeader *header = static_cast<NodeHeader*>(node) - 1;
+    if (header->arena == nullptr) {
+        ::operator delete(header);
+    }
+}
+
 Function *monicelli::makeMain(PointerList<Statement> *body) {
     PointerList<FunArg> *noargs = new PointerList<FunArg>();
 
@@ -22,8 +22,10 @@
 
 #include "Emitter.hpp"
 #include "Pointers.hpp"
+#include "Arena.hpp"
+#include "Interner.hpp"
 
-#include "location.hh"
+#include "SourceMap.hpp"
 
 #include <functional>
 #include <unordered_set>
@@ -54,18 +56,32 @@ enum class Operator {
 
 std::ostream& operator<<(std::ostream&, Operator const&);
 
+class FunctionPrototype;
+
 class Localizable {
 public:
-    void setLocation(location const& l) {
+    /**
+     * Nodes go to the current Arena of the thread, if there is one, and are
+     * only freed when that is released. Destructors still run as usual.
+     */
+    static void *operator new(size_t size);
+    static void operator delete(void *node);
+
+    void setLocation(SourceLocation const& l) {
         loc = l;
     }
 
-    location const& getLocation() const {
+    SourceLocation const& getSourceLocation() const {
         return loc;
     }
 
+    /** Line and column in the source being compiled on this thread. */
+    Location getLocation() const {
+        return SourceMap::resolve(loc);
+    }
+
 private:
-    location loc;
+    SourceLocation loc;
 };
 
 class Emittable: public Localizable {
@@ -77,7 +93,17 @@ public:
 
 class Statement: virtual public Emittable {};
 
-class Expression: virtual public Emittable {};
+class Expression: virtual public Emittable {
+public:
+    /** Filled in by SemanticAnalyzer, UNKNOWN until then. */
+    Type getType() const {
+        return type;
+    }
+
+private:
+    friend class SemanticAnalyzer;
+    mutable Type type = Type::UNKNOWN;
+};
 
 class SimpleExpression: public Expression {};
 
@@ -93,37 +119,45 @@ public:
         return op;
     }
 
+    /** Type both sides are converted to, filled in by SemanticAnalyzer. */
+    Type getOperandType() const {
+        return operandType;
+    }
+
 private:
+    friend class AstOptimizer;
+    friend class SemanticAnalyzer;
     Operator op;
     Pointer<Expression> left;
+    mutable Type operandType = Type::UNKNOWN;
 };
 
 
 class Id: public SimpleExpression {
 public:
-    explicit Id(std::string *c): value(c) {}
-    explicit Id(char const* c) {
-        value = Pointer<std::string>(new std::string(c));
-    }
-    explicit Id(std::string const& c) {
-        value = Pointer<std::string>(new std::string(c));
-    }
+    explicit Id(Symbol s): value(s) {}
+    explicit Id(char const* c): value(intern(c)) {}
+    explicit Id(std::string const& c): value(intern(c)) {}
 
     virtual bool emit(Emitter *emitter) const {
         return emitter->emit(*this);
     }
 
     std::string const& getValue() const {
-        return *value;
+        return value.getName();
+    }
+
+    Symbol getSymbol() const {
+        return value;
     }
 
 private:
-    Pointer<std::string> value;
+    Symbol value;
 };
 
 static inline
 bool operator==(Id const& a, Id const& b) {
-    return a.getValue() == b.getValue();
+    return a.getSymbol() == b.getSymbol();
 }
 
 
@@ -176,6 +210,7 @@ public:
     }
 
 private:
+    friend class AstOptimizer;
     Pointer<Expression> expression;
 };
 
@@ -197,6 +232,7 @@ public:
     }
 
 private:
+    friend class AstOptimizer;
     Pointer<PointerList<Statement>> body;
     Pointer<Expression> condition;
 };
@@ -228,6 +264,7 @@ public:
     }
 
 private:
+    friend class AstOptimizer;
     Pointer<Id> name;
     bool point;
     Pointer<Expression> init;
@@ -252,6 +289,7 @@ public:
     }
 
 private:
+    friend class AstOptimizer;
     Pointer<Id> name;
     Pointer<Expression> value;
 };
@@ -269,8 +307,16 @@ public:
         return *expression;
     }
 
+    /** Resolved by SemanticAnalyzer, null until then. */
+    FunctionPrototype const* getCallee() const {
+        return callee;
+    }
+
 private:
+    friend class AstOptimizer;
+    friend class SemanticAnalyzer;
     Pointer<Expression> expression;
+    mutable FunctionPrototype const* callee = nullptr;
 };
 
 
@@ -286,8 +332,15 @@ public:
         return *variable;
     }
 
+    /** Resolved by SemanticAnalyzer, null until then. */
+    FunctionPrototype const* getCallee() const {
+        return callee;
+    }
+
 private:
+    friend class SemanticAnalyzer;
     Pointer<Id> variable;
+    mutable FunctionPrototype const* callee = nullptr;
 };
 
 
@@ -312,6 +365,7 @@ public:
     }
 
 private:
+    friend class AstOptimizer;
     Pointer<Expression> expression;
 };
 
@@ -332,9 +386,17 @@ public:
         return *args;
     }
 
+    /** Resolved by SemanticAnalyzer, null until then. */
+    FunctionPrototype const* getCallee() const {
+        return callee;
+    }
+
 private:
+    friend class AstOptimizer;
+    friend class SemanticAnalyzer;
     Pointer<Id> name;
     Pointer<PointerList<Expression>> args;
+    mutable FunctionPrototype const* callee = nullptr;
 };
 
 class BranchCase: public Localizable {
@@ -350,6 +412,7 @@ public:
     }
 
 private:
+    friend class AstOptimizer;
     Pointer<SemiExpression> condition;
     Pointer<PointerList<Statement>> body;
 };
@@ -370,6 +433,7 @@ public:
         }
 
     private:
+        friend class AstOptimizer;
         Pointer<PointerList<BranchCase>> cases;
         Pointer<PointerList<Statement>> els;
     };
@@ -389,6 +453,7 @@ public:
     }
 
 private:
+    friend class AstOptimizer;
     Pointer<Id> var;
     Pointer<Branch::Body> body;
 };
@@ -453,7 +518,7 @@ bool operator==(const FunctionPrototype &a, const FunctionPrototype &b) {
 
 static inline
 size_t hash_value(const monicelli::FunctionPrototype &e) {
-    return std::hash<std::string>()(e.getName().getValue());
+    return std::hash<Symbol>()(e.getName().getSymbol());
 }
 
 class Function: public Emittable {
@@ -474,6 +539,7 @@ public:
     }
 
 private:
+    friend class AstOptimizer;
     Pointer<FunctionPrototype> prototype;
     Pointer<PointerList<Statement>> body;
 };
@@ -514,24 +580,82 @@ size_t hash_value(const monicelli::Module &e) {
     return std::hash<std::string>()(e.getName()) ^ std::hash<bool>()(e.getType());
 }
 
+/**
+ * Owns the arena all nodes of the program are allocated from, which is
+ * current on the creating thread for as long as the program is alive.
+ */
 class Program: public Emittable {
 public:
+    Program() {
+        previousArena = Arena::setCurrent(&arena);
+    }
+
+    virtual ~Program() {
+        Arena::setCurrent(previousArena);
+    }
+
+    Program(Program const&) = delete;
+    Program& operator=(Program const&) = delete;
+
     virtual bool emit(Emitter *emitter) const {
         return emitter->emit(*this);
     }
 
-    void setMain(Function *m) {
+    /** Takes ownership, returns false if a sink was given and failed. */
+    bool setMain(Function *m) {
+        if (sink) return handOver(m);
         main = Pointer<Function>(m);
+        return true;
     }
 
-    void addFunction(Function *f) {
+    bool addFunction(Function *f) {
+        if (sink) return handOver(f);
         functions.push_back(f);
+        return true;
     }
 
     void addModule(Module *m) {
+        // Modules are only read by the C++ emitter, which never streams,
+        // and would not survive the arena of the function naming them.
+        if (sink) {
+            delete m;
+            return;
+        }
         modules.insert(m);
     }
 
+    typedef std::function<bool(Function&)> FunctionSink;
+
+    /**
+     * Functions created from now on are handed to sink as soon as they are
+     * complete and then freed, along with their nodes, instead of being
+     * kept. An empty sink goes back to keeping them.
+     */
+    void streamTo(FunctionSink s) {
+        sink = s;
+        Arena::setCurrent(sink? &functionArena: &arena);
+    }
+
+    typedef std::function<bool(Emittable const&)> Sink;
+    typedef std::function<bool(Sink const&)> Stream;
+
+    /**
+     * Makes this a streamed program, whose functions are only parsed when
+     * it is emitted: stream() then runs s, which hands every prototype and
+     * function to the emitter's sink, one at a time.
+     */
+    void setStream(Stream s) {
+        streamer = s;
+    }
+
+    bool isStreamed() const {
+        return bool(streamer);
+    }
+
+    bool stream(Sink const& emit) const {
+        return streamer(emit);
+    }
+
     boost::optional<Function const&> getMain() const {
         maybe_return(main);
     }
@@ -544,7 +668,34 @@ public:
         return modules;
     }
 
+    Arena const& getArena() const {
+        return arena;
+    }
+
+    /** Path of the file the program was read from, if any. */
+    void setSource(std::string const& path) {
+        source = path;
+    }
+
+    std::string const& getSource() const {
+        return source;
+    }
+
 private:
+    bool handOver(Function *f) {
+        bool success = sink(*f);
+        delete f;
+        functionArena.release();
+        return success;
+    }
+
+    friend class AstOptimizer;
+    Arena arena;
+    Arena functionArena;
+    Arena *previousArena;
+    FunctionSink sink;
+    Stream streamer;
+    std::string source;
     Pointer<Function> main;
     PointerList<Function> functions;
     PointerSet<Module> modules;
@@ -572,10 +723,18 @@ public:
         return op;
     }
 
+    /** Type both sides are converted to, filled in by SemanticAnalyzer. */
+    Type getOperandType() const {
+        return operandType;
+    }
+
 private:
+    friend class AstOptimizer;
+    friend class SemanticAnalyzer;
     Pointer<Expression> left;
     Operator op;
     Pointer<Expression> right;
+    mutable Type operandType = Type::UNKNOWN;
 };
 
 
@@ -21,69 +21,571 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <assert.h>
+#include <unistd.h>
+#include <time.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Setting MONICELLI_FAST_IO=1 in the environment switches to buffered I/O,
+ * which avoids stdio for every value:
+ *  - output is collected in a large buffer, flushed at exit, on abort and
+ *    before prompting an interactive user;
+ *  - numbers are formatted by hand, with the same output as printf;
+ *  - input is read in bulk and parsed in place;
+ *  - the "? " prompt is only shown if stdin is a terminal.
+ */
+
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+#define INPUT_BUFFER_SIZE (1 << 16)
+#define MAX_NUMBER_LENGTH 64
+
+static int fastMode = -1;
+static int interactive = 1;
+
+static char outputBuffer[OUTPUT_BUFFER_SIZE];
+static size_t outputUsed = 0;
+
+/* One more byte for the terminator that strtod needs. */
+static char inputBuffer[INPUT_BUFFER_SIZE + 1];
+static size_t inputBegin = 0;
+static size_t inputEnd = 0;
+static int inputEof = 0;
+
+static void flushOutput(void) {
+    size_t written = 0;
+
+    while (written < outputUsed) {
+        ssize_t chunk = write(STDOUT_FILENO, outputBuffer + written, outputUsed - written);
+        if (chunk <= 0) break;
+        written += chunk;
+    }
+
+    outputUsed = 0;
+}
+
+static void initialize(void) {
+    char const* mode = getenv("MONICELLI_FAST_IO");
+    fastMode = mode != NULL && strcmp(mode, "0") != 0;
+
+    if (fastMode) {
+        interactive = isatty(STDIN_FILENO);
+        fflush(stdout);
+        atexit(flushOutput);
+    }
+}
+
+static inline int isFast(void) {
+    if (fastMode < 0) initialize();
+    return fastMode;
+}
+
+static void output(char const* data, size_t length) {
+    if (outputUsed + length > OUTPUT_BUFFER_SIZE) {
+        flushOutput();
+    }
+    memcpy(outputBuffer + outputUsed, data, length);
+    outputUsed += length;
+}
+
+static void outputInt(Monicelli_Int value) {
+    char digits[24];
+    char *cursor = digits + sizeof(digits);
+    uint64_t magnitude = value < 0? -(uint64_t) value: (uint64_t) value;
+
+    *--cursor = '\n';
+    do {
+        *--cursor = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) *--cursor = '-';
+
+    output(cursor, digits + sizeof(digits) - cursor);
+}
+
+static const double POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static void outputDoubleSlow(double value) {
+    char text[MAX_NUMBER_LENGTH];
+    int length = snprintf(text, sizeof(text), "%g\n", value);
+    output(text, length);
+}
+
+static char* stripZeros(char *begin, char *end) {
+    char *dot = memchr(begin, '.', end - begin);
+    if (dot == NULL) return end;
+    while (end[-1] == '0') --end;
+    if (end[-1] == '.') --end;
+    return end;
+}
+
+/*
+ * Same as printf("%g\n"). The value is scaled to six significant digits
+ * with a single, correctly rounded operation. When the result lies too close
+ * to a rounding boundary, or outside of the exact powers of ten, the slow
+ * path takes over so that the output always matches printf.
+ */
+static void outputDouble(double value) {
+    char text[MAX_NUMBER_LENGTH];
+    char *cursor = text;
+    double magnitude = value < 0? -value: value;
+
+    if (isnan(value) || isinf(value) || magnitude == 0) {
+        outputDoubleSlow(value);
+        return;
+    }
+
+    /* Only an estimate, it is checked below. */
+    int exponent = 0;
+    if (magnitude >= 1) {
+        while (exponent < 22 && POWERS_OF_TEN[exponent + 1] <= magnitude) ++exponent;
+    } else {
+        while (exponent > -22 && magnitude * POWERS_OF_TEN[-exponent] < 1) --exponent;
+    }
+
+    int shift = 5 - exponent;
+
+    if (shift < -22 || shift > 22) {
+        outputDoubleSlow(value);
+        return;
+    }
+
+    double scaled = shift >= 0?
+        magnitude * POWERS_OF_TEN[shift]: magnitude / POWERS_OF_TEN[-shift];
+
+    if (scaled < 1e5 || scaled >= 1e6) {
+        outputDoubleSlow(value);
+        return;
+    }
+
+    double fraction = scaled - (double) (int64_t) scaled;
+    if (fraction > 0.5 - 1e-6 && fraction < 0.5 + 1e-6) {
+        outputDoubleSlow(value);
+        return;
+    }
+
+    int64_t mantissa = (int64_t) (scaled + 0.5);
+    if (mantissa == 1000000) {
+        mantissa = 100000;
+        exponent += 1;
+    }
+
+    char digits[6];
+    for (int i = 5; i >= 0; --i) {
+        digits[i] = '0' + mantissa % 10;
+        mantissa /= 10;
+    }
+
+    if (value < 0) *cursor++ = '-';
+
+    if (exponent < -4 || exponent >= 6) {
+        char *begin = cursor;
+        *cursor++ = digits[0];
+        *cursor++ = '.';
+        memcpy(cursor, digits + 1, 5);
+        cursor = stripZeros(begin, cursor + 5);
+
+        int exponentMagnitude = exponent < 0? -exponent: exponent;
+        *cursor++ = 'e';
+        *cursor++ = exponent < 0? '-': '+';
+        if (exponentMagnitude >= 100) *cursor++ = '0' + exponentMagnitude / 100;
+        *cursor++ = '0' + exponentMagnitude / 10 % 10;
+        *cursor++ = '0' + exponentMagnitude % 10;
+    } else if (exponent >= 0) {
+        char *begin = cursor;
+        memcpy(cursor, digits, exponent + 1);
+        cursor += exponent + 1;
+        *cursor++ = '.';
+        memcpy(cursor, digits + exponent + 1, 5 - exponent);
+        cursor = stripZeros(begin, cursor + 5 - exponent);
+    } else {
+        char *begin = cursor;
+        *cursor++ = '0';
+        *cursor++ = '.';
+        for (int i = -1; i > exponent; --i) *cursor++ = '0';
+        memcpy(cursor, digits, 6);
+        cursor = stripZeros(begin, cursor + 6);
+    }
+
+    *cursor++ = '\n';
+    output(text, cursor - text);
+}
+
+static int fillInput(void) {
+    if (inputEof) return 0;
+
+    if (inputBegin > 0) {
+        memmove(inputBuffer, inputBuffer + inputBegin, inputEnd - inputBegin);
+        inputEnd -= inputBegin;
+        inputBegin = 0;
+    }
+
+    ssize_t chunk = read(STDIN_FILENO, inputBuffer + inputEnd, INPUT_BUFFER_SIZE - inputEnd);
+    if (chunk <= 0) {
+        inputEof = 1;
+        return 0;
+    }
+
+    inputEnd += chunk;
+    inputBuffer[inputEnd] = '\0';
+    return 1;
+}
+
+static int isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/* Skips blanks and makes sure the next token is completely buffered. */
+static char* inputToken(void) {
+    for (;;) {
+        while (inputBegin < inputEnd && isSpace(inputBuffer[inputBegin])) ++inputBegin;
+        if (inputBegin < inputEnd || !fillInput()) break;
+    }
+
+    for (;;) {
+        size_t end = inputBegin;
+        while (end < inputEnd && !isSpace(inputBuffer[end])) ++end;
+        if (end < inputEnd || end - inputBegin >= MAX_NUMBER_LENGTH || !fillInput()) break;
+    }
+
+    inputBuffer[inputEnd] = '\0';
+    return inputBuffer + inputBegin;
+}
+
+static int inputChar(void) {
+    if (inputBegin == inputEnd && !fillInput()) return 0;
+    return inputBuffer[inputBegin++];
+}
+
+static void prompt(void) {
+    if (!isFast()) {
+        printf("%s", "? ");
+    } else if (interactive) {
+        output("? ", 2);
+        flushOutput();
+    }
+}
 
 void __Monicelli_putBool(Monicelli_Bool value) {
+    if (isFast()) {
+        if (value) {
+            output("vero\n\n", 6);
+        } else {
+            output("falso\n\n", 7);
+        }
+        return;
+    }
     puts(value? "vero\n": "falso\n");
 }
 
 void __Monicelli_putChar(Monicelli_Char value) {
+    if (isFast()) {
+        char c = value;
+        output(&c, 1);
+        return;
+    }
     printf("%c", value);
 }
 
 void __Monicelli_putInt(Monicelli_Int value) {
+    if (isFast()) {
+        outputInt(value);
+        return;
+    }
     printf("%ld\n", value);
 }
 
 void __Monicelli_putFloat(Monicelli_Float value) {
+    if (isFast()) {
+        outputDouble(value);
+        return;
+    }
     printf("%g\n", value);
 }
 
 void __Monicelli_putDouble(Monicelli_Double value) {
+    if (isFast()) {
+        outputDouble(value);
+        return;
+    }
     printf("%lg\n", value);
 }
 
 Monicelli_Bool __Monicelli_getBool() {
     Monicelli_Bool tmp;
-    printf("%s", "? ");
+    prompt();
+    if (isFast()) {
+        return inputChar() != 0? 1: 0;
+    }
     scanf("%c", &tmp);
     return tmp != 0? 1: 0;
 }
 
 Monicelli_Char __Monicelli_getChar() {
     Monicelli_Char tmp;
-    printf("%s", "? ");
+    prompt();
+    if (isFast()) {
+        return inputChar();
+    }
     scanf("%c", &tmp);
     return tmp;
 }
 
 Monicelli_Int __Monicelli_getInt() {
     Monicelli_Int tmp;
-    printf("%s", "? ");
+    prompt();
+    if (isFast()) {
+        char *end;
+        char *begin = inputToken();
+        tmp = strtoll(begin, &end, 10);
+        inputBegin += end - begin;
+        return tmp;
+    }
     scanf("%ld", &tmp);
     return tmp;
 }
 
 Monicelli_Float __Monicelli_getFloat() {
     Monicelli_Float tmp;
-    printf("%s", "? ");
+    prompt();
+    if (isFast()) {
+        char *end;
+        char *begin = inputToken();
+        tmp = strtof(begin, &end);
+        inputBegin += end - begin;
+        return tmp;
+    }
     scanf("%f", &tmp);
     return tmp;
 }
 
 Monicelli_Double __Monicelli_getDouble() {
     Monicelli_Double tmp;
-    printf("%s", "? ");
+    prompt();
+    if (isFast()) {
+        char *end;
+        char *begin = inputToken();
+        tmp = strtod(begin, &end);
+        inputBegin += end - begin;
+        return tmp;
+    }
     scanf("%lf", &tmp);
     return tmp;
 }
 
+/*
+ * Instrumented programs register their counters when main starts, and
+ * write them out when it returns or the program aborts. Each line of the
+ * profile is a key followed by its count.
+ */
+
+static char const *profilePath = NULL;
+static Monicelli_ProfileCounter const *profileCounters = NULL;
+static Monicelli_Int profileSize = 0;
+
+void __Monicelli_profileInit(char const *path, Monicelli_ProfileCounter const *counters, Monicelli_Int size) {
+    profilePath = path;
+    profileCounters = counters;
+    profileSize = size;
+}
+
+void __Monicelli_profileWrite() {
+    if (profilePath == NULL) return;
+
+    FILE *out = fopen(profilePath, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot write profile to %s\n", profilePath);
+        return;
+    }
+
+    for (Monicelli_Int i = 0; i < profileSize; ++i) {
+        fprintf(out, "%s %llu\n", profileCounters[i].key,
+                (unsigned long long) *profileCounters[i].counter);
+    }
+
+    fclose(out);
+    profilePath = NULL;
+}
+
+/*
+ * Programs built with --profile call the profiler when entering and
+ * leaving each function. Time is measured in TSC ticks where available,
+ * which are converted to seconds with the wall clock time of the run.
+ * Recursive calls only add to the inclusive time of the outermost one.
+ */
+
+typedef struct {
+    uint64_t start;
+    uint64_t children;
+} ProfilerFrame;
+
+static char const *profilerPath = NULL;
+static Monicelli_ProfilerSite **profilerSites = NULL;
+static Monicelli_Int profilerSize = 0;
+
+static ProfilerFrame *profilerStack = NULL;
+static size_t profilerDepth = 0;
+static size_t profilerCapacity = 0;
+
+static uint64_t profilerStartTicks;
+static double profilerStartSeconds;
+
+static inline uint64_t readTicks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+#endif
+}
+
+static double readSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void __Monicelli_profilerStart(char const *path, Monicelli_ProfilerSite **sites, Monicelli_Int size) {
+    profilerPath = path;
+    profilerSites = sites;
+    profilerSize = size;
+    profilerStartSeconds = readSeconds();
+    profilerStartTicks = readTicks();
+}
+
+void __Monicelli_profilerEnter(Monicelli_ProfilerSite *site) {
+    if (profilerDepth == profilerCapacity) {
+        profilerCapacity = profilerCapacity > 0? 2 * profilerCapacity: 256;
+        profilerStack = realloc(profilerStack, profilerCapacity * sizeof(ProfilerFrame));
+        if (profilerStack == NULL) abort();
+    }
+
+    ProfilerFrame *frame = &profilerStack[profilerDepth++];
+    frame->children = 0;
+
+    site->count += 1;
+    site->active += 1;
+
+    frame->start = readTicks();
+}
+
+void __Monicelli_profilerExit(Monicelli_ProfilerSite *site) {
+    uint64_t now = readTicks();
+
+    if (profilerDepth == 0) return;
+
+    ProfilerFrame *frame = &profilerStack[--profilerDepth];
+    uint64_t elapsed = now - frame->start;
+
+    site->exclusive += elapsed - frame->children;
+    site->active -= 1;
+
+    if (site->active == 0) {
+        site->inclusive += elapsed;
+    }
+
+    if (profilerDepth > 0) {
+        profilerStack[profilerDepth - 1].children += elapsed;
+    }
+}
+
+/* Functions first, by exclusive time, then loops by iterations. */
+static int compareSites(void const *a, void const *b) {
+    Monicelli_ProfilerSite const *left = *(Monicelli_ProfilerSite * const*) a;
+    Monicelli_ProfilerSite const *right = *(Monicelli_ProfilerSite * const*) b;
+
+    if (left->isLoop != right->isLoop) {
+        return left->isLoop < right->isLoop? -1: 1;
+    }
+
+    uint64_t leftKey = left->isLoop? left->count: left->exclusive;
+    uint64_t rightKey = right->isLoop? right->count: right->exclusive;
+
+    if (leftKey != rightKey) {
+        return leftKey > rightKey? -1: 1;
+    }
+    return 0;
+}
+
+void __Monicelli_profilerReport() {
+    if (profilerSites == NULL) return;
+
+    double seconds = readSeconds() - profilerStartSeconds;
+    uint64_t ticks = readTicks() - profilerStartTicks;
+    double tick = ticks > 0? seconds / ticks: 0;
+
+    Monicelli_ProfilerSite **sites = malloc(profilerSize * sizeof(*sites));
+    if (sites == NULL) return;
+
+    memcpy(sites, profilerSites, profilerSize * sizeof(*sites));
+    qsort(sites, profilerSize, sizeof(*sites), compareSites);
+    profilerSites = NULL;
+
+    if (isFast()) flushOutput();
+    fflush(stdout);
+
+    FILE *out = stderr;
+    if (profilerPath[0] != '\0') {
+        out = fopen(profilerPath, "w");
+        if (out == NULL) {
+            fprintf(stderr, "Cannot write profile report to %s\n", profilerPath);
+            out = stderr;
+        }
+    }
+
+    fprintf(out, "%-24s %12s %14s %14s  %s\n",
+            "function", "calls", "inclusive (s)", "exclusive (s)", "line:col");
+
+    int loops = 0;
+
+    for (Monicelli_Int i = 0; i < profilerSize; ++i) {
+        Monicelli_ProfilerSite const *site = sites[i];
+
+        if (site->isLoop && !loops) {
+            fprintf(out, "\n%-24s %12s  %s\n", "loop in", "iterations", "line:col");
+            loops = 1;
+        }
+
+        if (site->isLoop) {
+            fprintf(out, "%-24s %12llu  %lld:%lld\n", site->function,
+                    (unsigned long long) site->count,
+                    (long long) site->line, (long long) site->column);
+        } else {
+            fprintf(out, "%-24s %12llu %14.6f %14.6f  %lld:%lld\n", site->function,
+                    (unsigned long long) site->count,
+                    site->inclusive * tick, site->exclusive * tick,
+                    (long long) site->line, (long long) site->column);
+        }
+    }
+
+    fprintf(out, "\ntotal %.6f s\n", seconds);
+
+    if (out != stderr) fclose(out);
+    free(sites);
+}
+
 void __Monicelli_abort() {
+    if (isFast()) flushOutput();
+    __Monicelli_profileWrite();
+    __Monicelli_profilerReport();
     abort();
 }
 
 void __Monicelli_assert(Monicelli_Bool condition) {
+    if (!condition) {
+        if (isFast()) flushOutput();
+        __Monicelli_profileWrite();
+        __Monicelli_profilerReport();
+    }
     assert(condition);
 }
-
@@ -48,6 +48,32 @@ void __Monicelli_abort();
 
 void __Monicelli_assert(Monicelli_Bool condition);
 
+/* A counter of a program built with mcc --profile-generate. */
+typedef struct {
+    char const *key;
+    uint64_t *counter;
+} Monicelli_ProfileCounter;
+
+void __Monicelli_profileInit(char const *path, Monicelli_ProfileCounter const *counters, Monicelli_Int size);
+void __Monicelli_profileWrite();
+
+/* A function or a loop of a program built with mcc --profile. */
+typedef struct {
+    char const *function;
+    Monicelli_Int line;
+    Monicelli_Int column;
+    Monicelli_Int isLoop;
+    uint64_t count;
+    uint64_t inclusive;
+    uint64_t exclusive;
+    int64_t active;
+} Monicelli_ProfilerSite;
+
+void __Monicelli_profilerStart(char const *path, Monicelli_ProfilerSite **sites, Monicelli_Int size);
+void __Monicelli_profilerEnter(Monicelli_ProfilerSite *site);
+void __Monicelli_profilerExit(Monicelli_ProfilerSite *site);
+void __Monicelli_profilerReport();
+
 #ifdef __cplusplus
 }
 #endif
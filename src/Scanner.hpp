@@ -30,16 +30,30 @@ namespace monicelli {
 
 class Scanner: public yyFlexLexer {
 public:
-    Scanner(std::istream *in): yyFlexLexer(in) {}
+    Scanner(std::istream *in): yyFlexLexer(in), buffer(nullptr), remaining(0), offset(0) {}
 
+    /**
+     * Reads from memory, which must outlive the scanner, without going
+     * through a stream.
+     */
+    Scanner(char const *data, size_t size): buffer(data), remaining(size), offset(0) {}
+
+    /** Timed as part of the parse, a phase per token would cost more. */
     int yylex(Parser::semantic_type *lval, Parser::location_type *loc) {
         this->lval = lval;
         location = loc;
         return yylex();
     }
 
+protected:
+    virtual int LexerInput(char *buf, int max_size);
+
 private:
     int yylex();
+    char const *buffer;
+    size_t remaining;
+    // Bytes matched so far, tokens are located at the end of their match.
+    uint32_t offset;
     Parser::semantic_type *lval;
     Parser::location_type *location;
 };
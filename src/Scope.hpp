@@ -20,6 +20,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "Interner.hpp"
+
 #include <boost/optional.hpp>
 #include <boost/range/adaptor/reversed.hpp>
 
@@ -65,6 +67,76 @@ private:
     std::vector<std::unordered_map<Key, Value>> tables;
 };
 
+/**
+ * Same interface as Scope, keyed on symbols. Visible bindings live in one
+ * array indexed by symbol id, bindings shadowed by push() are kept in an
+ * undo log and restored by leave(), so lookups never hash nor walk levels.
+ */
+template<class Value>
+class FlatScope {
+public:
+    boost::optional<Value> lookup(Symbol name) const {
+        size_t id = name.getId();
+        if (id < slots.size() && slots[id].depth != 0) {
+            return slots[id].value;
+        }
+
+        return boost::none;
+    }
+
+    void push(Symbol key, Value const& value) {
+        size_t id = key.getId();
+        if (id >= slots.size()) {
+            slots.resize(id + 1);
+        }
+
+        Slot &slot = slots[id];
+        // Like inserting twice in the same map: the first binding stays.
+        if (slot.depth == marks.size() + 1) return;
+
+        undo.push_back({id, slot});
+        slot.value = value;
+        slot.depth = marks.size() + 1;
+    }
+
+    void enter() {
+        marks.push_back(undo.size());
+    }
+
+    void leave() {
+        if (marks.empty()) return;
+
+        for (size_t i = undo.size(); i > marks.back(); --i) {
+            slots[undo[i - 1].id] = undo[i - 1].previous;
+        }
+
+        undo.resize(marks.back());
+        marks.pop_back();
+    }
+
+    void drop() {
+        slots.clear();
+        undo.clear();
+        marks.clear();
+    }
+
+private:
+    struct Slot {
+        Value value = Value();
+        // One more than the level bound at, 0 if unbound.
+        size_t depth = 0;
+    };
+
+    struct Change {
+        size_t id;
+        Slot previous;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<Change> undo;
+    std::vector<size_t> marks;
+};
+
 }
 
 #endif
@@ -0,0 +1,358 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "SemanticAnalyzer.hpp"
+#include "ModuleRegistry.hpp"
+#include "Diagnostics.hpp"
+
+#include <initializer_list>
+#include <string>
+
+using namespace monicelli;
+
+#define GUARDED(call) if (!(call)) return false
+
+namespace {
+
+constexpr size_t TYPES = static_cast<size_t>(Type::UNKNOWN) + 1;
+
+constexpr size_t index(Type type) {
+    return static_cast<size_t>(type);
+}
+
+/**
+ * Type both operands of a binary operator are converted to, by type of
+ * the left and of the right one. UNKNOWN where they cannot be combined.
+ * Rows and columns follow the order of the Type enum.
+ */
+constexpr Type PROMOTIONS[TYPES][TYPES] = {
+    // INT
+    {Type::INT, Type::INT, Type::DOUBLE, Type::INT, Type::DOUBLE, Type::UNKNOWN, Type::UNKNOWN},
+    // CHAR
+    {Type::INT, Type::CHAR, Type::FLOAT, Type::CHAR, Type::DOUBLE, Type::UNKNOWN, Type::UNKNOWN},
+    // FLOAT
+    {Type::DOUBLE, Type::FLOAT, Type::FLOAT, Type::FLOAT, Type::DOUBLE, Type::UNKNOWN, Type::UNKNOWN},
+    // BOOL
+    {Type::INT, Type::CHAR, Type::FLOAT, Type::BOOL, Type::DOUBLE, Type::UNKNOWN, Type::UNKNOWN},
+    // DOUBLE
+    {Type::DOUBLE, Type::DOUBLE, Type::DOUBLE, Type::DOUBLE, Type::DOUBLE, Type::UNKNOWN, Type::UNKNOWN},
+    // VOID
+    {Type::UNKNOWN, Type::UNKNOWN, Type::UNKNOWN, Type::UNKNOWN, Type::UNKNOWN, Type::UNKNOWN, Type::UNKNOWN},
+    // UNKNOWN
+    {Type::UNKNOWN, Type::UNKNOWN, Type::UNKNOWN, Type::UNKNOWN, Type::UNKNOWN, Type::UNKNOWN, Type::UNKNOWN}
+};
+
+static_assert(PROMOTIONS[index(Type::CHAR)][index(Type::BOOL)] == Type::CHAR, "rows out of order");
+static_assert(PROMOTIONS[index(Type::FLOAT)][index(Type::INT)] == Type::DOUBLE, "rows out of order");
+
+constexpr Type promote(Type left, Type right) {
+    return PROMOTIONS[index(left)][index(right)];
+}
+
+/** Values of any of these types can be converted to one another. */
+constexpr bool isValue(Type type) {
+    return type != Type::VOID && type != Type::UNKNOWN;
+}
+
+constexpr bool isFloating(Type type) {
+    return type == Type::FLOAT || type == Type::DOUBLE;
+}
+
+constexpr char const* PUT_NAMES[TYPES] = {
+    "__Monicelli_putInt",
+    "__Monicelli_putChar",
+    "__Monicelli_putFloat",
+    "__Monicelli_putBool",
+    "__Monicelli_putDouble",
+    nullptr,
+    nullptr
+};
+
+constexpr char const* GET_NAMES[TYPES] = {
+    "__Monicelli_getInt",
+    "__Monicelli_getChar",
+    "__Monicelli_getFloat",
+    "__Monicelli_getBool",
+    "__Monicelli_getDouble",
+    nullptr,
+    nullptr
+};
+
+bool reportError(Localizable const& node, std::initializer_list<std::string> const& what) {
+    std::ostream &out = diagnostics();
+
+    out << "line " << node.getLocation().begin.line << ", ";
+    out << "col " << node.getLocation().begin.column << ": ";
+
+    for (std::string const& chunk: what) {
+        out << chunk << ' ';
+    }
+    out << std::endl;
+
+    return false;
+}
+
+/** Type of the result of an operator applied to values of that type. */
+Type resultType(Operator op, Type operands) {
+    switch (op) {
+        case Operator::LT:
+        case Operator::GT:
+        case Operator::LTE:
+        case Operator::GTE:
+        case Operator::EQ:
+            return Type::BOOL;
+        default:
+            return operands;
+    }
+}
+
+bool checkOperands(Localizable const& node, Operator op, Type operands) {
+    if (operands == Type::UNKNOWN) {
+        return reportError(node, {"Cannot combine operators."});
+    }
+
+    if (isFloating(operands)) {
+        if (op == Operator::SHL) {
+            return reportError(node, {"Operator << cannot be applied to float values!"});
+        }
+        if (op == Operator::SHR) {
+            return reportError(node, {"Operator >> cannot be applied to float values!"});
+        }
+    }
+
+    return true;
+}
+
+}
+
+SemanticAnalyzer::SemanticAnalyzer() {}
+
+void SemanticAnalyzer::declare(FunctionPrototype const& prototype) {
+    functions[prototype.getName().getSymbol()] = &prototype;
+}
+
+bool SemanticAnalyzer::analyze(Program const& program) {
+    for (Function const& function: program.getFunctions()) {
+        declare(function.getPrototype());
+    }
+
+    for (Function const& function: program.getFunctions()) {
+        GUARDED(analyze(function));
+    }
+
+    if (program.getMain()) {
+        GUARDED(analyze(*program.getMain()));
+    }
+
+    return true;
+}
+
+bool SemanticAnalyzer::analyze(Function const& function) {
+    scope.drop();
+    scope.enter();
+
+    for (FunArg const& arg: function.getPrototype().getArgs()) {
+        scope.push(arg.getName().getSymbol(), arg.getType());
+    }
+
+    bool analyzed = analyze(function.getBody());
+    scope.leave();
+
+    return analyzed;
+}
+
+bool SemanticAnalyzer::analyze(PointerList<Statement> const& statements) {
+    scope.enter();
+
+    for (Statement const& statement: statements) {
+        if (!analyze(statement)) {
+            scope.leave();
+            return false;
+        }
+    }
+
+    scope.leave();
+
+    return true;
+}
+
+bool SemanticAnalyzer::analyze(Statement const& statement) {
+    if (Return const *node = dynamic_cast<Return const*>(&statement)) {
+        if (node->getExpression()) GUARDED(analyze(*node->getExpression()));
+    } else if (Loop const *node = dynamic_cast<Loop const*>(&statement)) {
+        GUARDED(analyze(node->getBody()));
+        GUARDED(analyze(node->getCondition()));
+    } else if (VarDeclaration const *node = dynamic_cast<VarDeclaration const*>(&statement)) {
+        if (node->getInitializer()) {
+            GUARDED(analyze(*node->getInitializer()));
+            if (!isValue(node->getInitializer()->getType())) {
+                return reportError(*node, {
+                    "Invalid inizializer for variable", node->getId().getValue()
+                });
+            }
+        }
+        scope.push(node->getId().getSymbol(), node->getType());
+    } else if (Assignment const *node = dynamic_cast<Assignment const*>(&statement)) {
+        if (!scope.lookup(node->getName().getSymbol())) {
+            return reportError(*node, {
+                "Attempting assignment to undefined variable",
+                node->getName().getValue()
+            });
+        }
+        GUARDED(analyze(node->getValue()));
+        if (!isValue(node->getValue().getType())) {
+            return reportError(*node, {
+                "Invalid assignment to variable", node->getName().getValue()
+            });
+        }
+    } else if (Print const *node = dynamic_cast<Print const*>(&statement)) {
+        GUARDED(analyze(node->getExpression()));
+        Type type = node->getExpression().getType();
+        if (type == Type::UNKNOWN) {
+            return reportError(*node, {"Attempting to print unknown type"});
+        }
+        if (PUT_NAMES[index(type)] == nullptr) {
+            return reportError(*node, {"Unknown print function for type"});
+        }
+        node->callee = runtime(PUT_NAMES, type);
+        if (node->callee == nullptr) {
+            return reportError(*node, {"Print function was not registered"});
+        }
+    } else if (Input const *node = dynamic_cast<Input const*>(&statement)) {
+        auto type = scope.lookup(node->getVariable().getSymbol());
+        if (!type) {
+            return reportError(*node, {
+                "Attempting to read undefined variable",
+                node->getVariable().getValue()
+            });
+        }
+        if (*type == Type::UNKNOWN) {
+            return reportError(*node, {"Attempting to read unknown type"});
+        }
+        if (GET_NAMES[index(*type)] == nullptr) {
+            return reportError(*node, {"Unknown input function for type"});
+        }
+        node->callee = runtime(GET_NAMES, *type);
+        if (node->callee == nullptr) {
+            return reportError(*node, {"Input function was not registered for type"});
+        }
+    } else if (Assert const *node = dynamic_cast<Assert const*>(&statement)) {
+        GUARDED(analyze(node->getExpression()));
+    } else if (FunctionCall const *node = dynamic_cast<FunctionCall const*>(&statement)) {
+        GUARDED(analyze(*node));
+    } else if (Branch const *node = dynamic_cast<Branch const*>(&statement)) {
+        Branch::Body const& body = node->getBody();
+        for (BranchCase const& branchCase: body.getCases()) {
+            GUARDED(analyze(node->getVar(), branchCase.getCondition()));
+            GUARDED(analyze(branchCase.getBody()));
+        }
+        if (body.getElse()) {
+            GUARDED(analyze(*body.getElse()));
+        }
+    }
+
+    return true;
+}
+
+bool SemanticAnalyzer::analyze(Expression const& expression) {
+    if (Id const *node = dynamic_cast<Id const*>(&expression)) {
+        auto type = scope.lookup(node->getSymbol());
+        if (!type) {
+            return reportError(*node, {"Undefined variable", node->getValue()});
+        }
+        node->type = *type;
+    } else if (dynamic_cast<Integer const*>(&expression) != nullptr) {
+        expression.type = Type::INT;
+    } else if (dynamic_cast<Float const*>(&expression) != nullptr) {
+        // Float literals are emitted as doubles.
+        expression.type = Type::DOUBLE;
+    } else if (FunctionCall const *node = dynamic_cast<FunctionCall const*>(&expression)) {
+        GUARDED(analyze(*node));
+    } else if (BinaryExpression const *node = dynamic_cast<BinaryExpression const*>(&expression)) {
+        GUARDED(analyze(node->getLeft()));
+        GUARDED(analyze(node->getRight()));
+        node->operandType = promote(node->getLeft().getType(), node->getRight().getType());
+        GUARDED(checkOperands(*node, node->getOperator(), node->operandType));
+        node->type = resultType(node->getOperator(), node->operandType);
+    }
+
+    return true;
+}
+
+bool SemanticAnalyzer::analyze(Id const& variable, SemiExpression const& condition) {
+    GUARDED(analyze(static_cast<Expression const&>(variable)));
+    GUARDED(analyze(condition.getLeft()));
+    condition.operandType = promote(variable.getType(), condition.getLeft().getType());
+
+    return checkOperands(condition, condition.getOperator(), condition.operandType);
+}
+
+bool SemanticAnalyzer::analyze(FunctionCall const& call) {
+    FunctionPrototype const *callee = lookup(call.getName().getSymbol());
+
+    if (callee == nullptr) {
+        return reportError(call, {
+            "Attempting to call undefined function",
+            call.getName().getValue() + "()"
+        });
+    }
+
+    PointerList<FunArg> const& params = callee->getArgs();
+
+    if (params.size() != call.getArgs().size()) {
+        return reportError(call, {
+            "Argument number mismatch in call of",
+            call.getName().getValue() + "()",
+            "expected", std::to_string(params.size()),
+            "given", std::to_string(call.getArgs().size())
+        });
+    }
+
+    for (size_t i = 0; i < params.size(); ++i) {
+        GUARDED(analyze(call.getArgs()[i]));
+        if (!isValue(call.getArgs()[i].getType())) {
+            return reportError(call.getArgs()[i], {
+                "Invalid argument", std::to_string(i + 1),
+                "in call of", call.getName().getValue() + "()"
+            });
+        }
+    }
+
+    call.callee = callee;
+    call.type = callee->getType();
+
+    return true;
+}
+
+FunctionPrototype const* SemanticAnalyzer::lookup(Symbol name) {
+    auto function = functions.find(name);
+    if (function != functions.end()) return function->second;
+
+    FunctionPrototype const *prototype = getModuleRegistry().lookup(name);
+    if (prototype != nullptr) {
+        functions.insert({name, prototype});
+    }
+
+    return prototype;
+}
+
+FunctionPrototype const* SemanticAnalyzer::runtime(char const* const names[], Type type) {
+    return lookup(intern(names[index(type)]));
+}
@@ -0,0 +1,63 @@
+#ifndef SEMANTIC_ANALYZER_HPP
+#define SEMANTIC_ANALYZER_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Nodes.hpp"
+#include "Scope.hpp"
+
+#include <unordered_map>
+
+namespace monicelli {
+
+/**
+ * Resolves the type of every expression and the function called by every
+ * call, print and input, storing them on the nodes, and reports semantic
+ * errors before any code is emitted. Emitters read the annotations
+ * instead of deducing them again.
+ */
+class SemanticAnalyzer {
+public:
+    SemanticAnalyzer();
+
+    /** Makes the function callable from anything analyzed afterwards. */
+    void declare(FunctionPrototype const& prototype);
+
+    bool analyze(Program const& program);
+    bool analyze(Function const& function);
+
+private:
+    bool analyze(PointerList<Statement> const& statements);
+    bool analyze(Statement const& statement);
+    bool analyze(Expression const& expression);
+    bool analyze(Id const& variable, SemiExpression const& condition);
+    bool analyze(FunctionCall const& call);
+
+    FunctionPrototype const* lookup(Symbol name);
+    FunctionPrototype const* runtime(char const* const names[], Type type);
+
+    FlatScope<Type> scope;
+    std::unordered_map<Symbol, FunctionPrototype const*> functions;
+};
+
+}
+
+#endif
@@ -0,0 +1,399 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Server.hpp"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+using namespace monicelli;
+
+// A request is a 32 bit length followed by as many bytes of NUL terminated
+// strings: the directory, then the arguments. The standard streams of the
+// client travel along with its first byte. The reply is a 32 bit status.
+static const int STREAMS = 3;
+static const uint32_t MAX_REQUEST_SIZE = 1 << 24;
+
+std::string monicelli::defaultServerSocket() {
+    char const *path = std::getenv("MCC_SERVER");
+    if (path != nullptr && *path != '\0') return path;
+    return "/tmp/mcc-server-" + std::to_string(getuid());
+}
+
+static
+bool makeAddress(std::string const& path, sockaddr_un &address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << path << ": socket path is too long" << std::endl;
+        return false;
+    }
+
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+static
+bool sendAll(int socket, char const *data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(socket, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static
+bool receiveAll(int socket, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t received = recv(socket, data, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+static
+bool sendRequest(int socket, ServerRequest const& request) {
+    std::string payload = request.directory + '\0';
+    for (std::string const& argument: request.arguments) {
+        payload += argument + '\0';
+    }
+
+    uint32_t length = payload.size();
+    std::string message(reinterpret_cast<char const*>(&length), sizeof(length));
+    message += payload;
+
+    int streams[STREAMS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(streams))];
+    std::memset(control, 0, sizeof(control));
+
+    iovec first = {&message[0], 1};
+    msghdr header;
+    std::memset(&header, 0, sizeof(header));
+    header.msg_iov = &first;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+
+    cmsghdr *streamsHeader = CMSG_FIRSTHDR(&header);
+    streamsHeader->cmsg_level = SOL_SOCKET;
+    streamsHeader->cmsg_type = SCM_RIGHTS;
+    streamsHeader->cmsg_len = CMSG_LEN(sizeof(streams));
+    std::memcpy(CMSG_DATA(streamsHeader), streams, sizeof(streams));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket, &header, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent != 1) return false;
+    return sendAll(socket, message.data() + 1, message.size() - 1);
+}
+
+static
+void closeStreams(int streams[STREAMS]) {
+    for (int i = 0; i < STREAMS; ++i) {
+        close(streams[i]);
+    }
+}
+
+static
+bool receiveRequest(int socket, ServerRequest &request, int streams[STREAMS]) {
+    uint32_t length;
+    char *lengthBytes = reinterpret_cast<char*>(&length);
+    char control[CMSG_SPACE(sizeof(int) * STREAMS)];
+
+    iovec first = {lengthBytes, 1};
+    msghdr header;
+    std::memset(&header, 0, sizeof(header));
+    header.msg_iov = &first;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do {
+        received = recvmsg(socket, &header, 0);
+    } while (received < 0 && errno == EINTR);
+
+    cmsghdr *streamsHeader = CMSG_FIRSTHDR(&header);
+    if (received != 1 || streamsHeader == nullptr ||
+            streamsHeader->cmsg_level != SOL_SOCKET ||
+            streamsHeader->cmsg_type != SCM_RIGHTS ||
+            streamsHeader->cmsg_len != CMSG_LEN(sizeof(int) * STREAMS)) {
+        return false;
+    }
+
+    std::memcpy(streams, CMSG_DATA(streamsHeader), sizeof(int) * STREAMS);
+
+    if (!receiveAll(socket, lengthBytes + 1, sizeof(length) - 1) || length > MAX_REQUEST_SIZE) {
+        closeStreams(streams);
+        return false;
+    }
+
+    std::string payload(length, '\0');
+    if (!receiveAll(socket, &payload[0], length)) {
+        closeStreams(streams);
+        return false;
+    }
+
+    std::vector<std::string> strings;
+    for (size_t begin = 0; begin < payload.size();) {
+        size_t end = payload.find('\0', begin);
+        if (end == std::string::npos) end = payload.size();
+        strings.push_back(payload.substr(begin, end - begin));
+        begin = end + 1;
+    }
+
+    if (strings.size() < 2) {
+        closeStreams(streams);
+        return false;
+    }
+
+    request.directory = strings.front();
+    request.arguments.assign(strings.begin() + 1, strings.end());
+
+    return true;
+}
+
+static int wakeup[2];
+
+static
+void childExited(int) {
+    int saved = errno;
+    char byte = 0;
+    ssize_t ignored = write(wakeup[1], &byte, 1);
+    (void) ignored;
+    errno = saved;
+}
+
+static
+void runChild(ServerRequest const& request, int streams[STREAMS], RequestHandler const& handle) {
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+
+    for (int i = 0; i < STREAMS; ++i) {
+        dup2(streams[i], i);
+    }
+    closeStreams(streams);
+
+    if (chdir(request.directory.c_str()) != 0) {
+        std::cerr << request.directory << ": " << std::strerror(errno) << std::endl;
+        std::exit(1);
+    }
+
+    std::vector<char*> argv;
+    for (std::string const& argument: request.arguments) {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    int status = handle(argv.size() - 1, argv.data());
+    std::cout.flush();
+    std::exit(status);
+}
+
+static
+void replyFinished(std::map<pid_t, int> &clients) {
+    char drain[64];
+    while (read(wakeup[0], drain, sizeof(drain)) > 0) {}
+
+    int status;
+    pid_t pid;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        auto client = clients.find(pid);
+        if (client == clients.end()) continue;
+
+        int32_t code = WIFEXITED(status)? WEXITSTATUS(status): 128 + WTERMSIG(status);
+        sendAll(client->second, reinterpret_cast<char const*>(&code), sizeof(code));
+        close(client->second);
+        clients.erase(client);
+    }
+}
+
+static
+void acceptRequest(int listener, std::map<pid_t, int> &clients,
+                   RequestPreparer const& prepare, RequestHandler const& handle) {
+    int client = accept(listener, nullptr, nullptr);
+    if (client < 0) return;
+
+    fcntl(client, F_SETFD, FD_CLOEXEC);
+
+    // A client which does not finish sending must not stall the server.
+    timeval timeout = {5, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    ServerRequest request;
+    int streams[STREAMS];
+
+    if (!receiveRequest(client, request, streams)) {
+        close(client);
+        return;
+    }
+
+    prepare(request);
+
+    std::cout.flush();
+    std::fflush(nullptr);
+
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        close(listener);
+        close(wakeup[0]);
+        close(wakeup[1]);
+        runChild(request, streams, handle);
+    }
+
+    closeStreams(streams);
+
+    if (pid < 0) {
+        int32_t code = 1;
+        sendAll(client, reinterpret_cast<char const*>(&code), sizeof(code));
+        close(client);
+        return;
+    }
+
+    clients[pid] = client;
+}
+
+int monicelli::serve(std::string const& path, RequestPreparer const& prepare, RequestHandler const& handle) {
+    sockaddr_un address;
+    if (!makeAddress(path, address)) return 1;
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::cerr << "Cannot create socket: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    fcntl(listener, F_SETFD, FD_CLOEXEC);
+    unlink(path.c_str());
+
+    // Only the user running the server may connect.
+    mode_t mask = umask(S_IRWXG | S_IRWXO);
+    bool bound = bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    umask(mask);
+
+    if (!bound || listen(listener, SOMAXCONN) != 0 || pipe(wakeup) != 0) {
+        std::cerr << path << ": " << std::strerror(errno) << std::endl;
+        close(listener);
+        return 1;
+    }
+
+    for (int end: wakeup) {
+        fcntl(end, F_SETFL, O_NONBLOCK);
+        fcntl(end, F_SETFD, FD_CLOEXEC);
+    }
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = childExited;
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::cerr << "mcc server listening on " << path << std::endl;
+
+    std::map<pid_t, int> clients;
+
+    for (;;) {
+        pollfd events[2] = {{listener, POLLIN, 0}, {wakeup[0], POLLIN, 0}};
+
+        if (poll(events, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Server stopped: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        if (events[1].revents & POLLIN) {
+            replyFinished(clients);
+        }
+
+        if (events[0].revents & POLLIN) {
+            acceptRequest(listener, clients, prepare, handle);
+        }
+    }
+
+    close(listener);
+    unlink(path.c_str());
+
+    return 1;
+}
+
+int monicelli::forwardToServer(std::string const& path, int argc, char **argv) {
+    sockaddr_un address;
+    if (!makeAddress(path, address)) return -1;
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) return -1;
+
+    char directory[PATH_MAX];
+    bool connected = connect(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+
+    if (!connected || getcwd(directory, sizeof(directory)) == nullptr) {
+        close(server);
+        return -1;
+    }
+
+    ServerRequest request;
+    request.directory = directory;
+    request.arguments.assign(argv, argv + argc);
+
+    if (!sendRequest(server, request)) {
+        close(server);
+        return -1;
+    }
+
+    int32_t status;
+    bool answered = receiveAll(server, reinterpret_cast<char*>(&status), sizeof(status));
+    close(server);
+
+    if (!answered) {
+        std::cerr << "The mcc server at " << path << " did not answer" << std::endl;
+        return 1;
+    }
+
+    return status;
+}
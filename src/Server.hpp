@@ -0,0 +1,66 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace monicelli {
+
+/**
+ * A compilation asked to the server: the command line of the client and
+ * the directory it runs in.
+ */
+struct ServerRequest {
+    std::string directory;
+    std::vector<std::string> arguments;
+};
+
+/** Runs in the server before each request is forked off. */
+typedef std::function<void(ServerRequest const&)> RequestPreparer;
+
+/** Runs in the forked child, after entering the client's directory. */
+typedef std::function<int(int, char**)> RequestHandler;
+
+/**
+ * Socket mcc --server listens on unless given one, and mcc-client uses:
+ * $MCC_SERVER, or else a per-user path in /tmp.
+ */
+std::string defaultServerSocket();
+
+/**
+ * Accepts requests on a Unix socket until killed. Each runs in a child
+ * process with the standard streams of the client, which gets back the
+ * exit status. Whatever prepare sets up is inherited by all of them.
+ */
+int serve(std::string const& path, RequestPreparer const& prepare, RequestHandler const& handle);
+
+/**
+ * Has the server run this command line, with the standard streams of the
+ * caller. Returns the exit status, or -1 if no server is listening.
+ */
+int forwardToServer(std::string const& path, int argc, char **argv);
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "SourceMap.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace monicelli;
+
+static thread_local SourceMap const* currentMap = nullptr;
+
+std::ostream& monicelli::operator<<(std::ostream &stream, SourceLocation const& loc) {
+    return stream << "offset " << loc.begin << '-' << loc.end;
+}
+
+SourceMap::SourceMap(char const *data, size_t size): data(data), size(size) {}
+
+Position SourceMap::locate(uint32_t offset) const {
+    if (starts.empty()) {
+        starts.push_back(0);
+        char const *end = data + size;
+        for (char const *p = data; p != end; ++p) {
+            p = static_cast<char const*>(std::memchr(p, '\n', end - p));
+            if (p == nullptr) break;
+            starts.push_back(p + 1 - data);
+        }
+    }
+
+    auto next = std::upper_bound(starts.begin(), starts.end(), offset);
+    unsigned line = next - starts.begin();
+    return {line, offset - *(next - 1) + 1};
+}
+
+Location SourceMap::resolve(SourceLocation const& loc) {
+    if (currentMap == nullptr) {
+        return {{1, 1}, {1, 1}};
+    }
+    return {currentMap->locate(loc.begin), currentMap->locate(loc.end)};
+}
+
+SourceMap const* SourceMap::current() {
+    return currentMap;
+}
+
+SourceMap const* SourceMap::setCurrent(SourceMap const* map) {
+    SourceMap const* previous = currentMap;
+    currentMap = map;
+    return previous;
+}
@@ -0,0 +1,101 @@
+#ifndef SOURCEMAP_HPP
+#define SOURCEMAP_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace monicelli {
+
+/**
+ * Where a node comes from, as byte offsets in its source. The scanner only
+ * counts bytes, lines and columns are worked out by SourceMap when asked.
+ */
+struct SourceLocation {
+    uint32_t begin = 0;
+    uint32_t end = 0;
+};
+
+std::ostream& operator<<(std::ostream&, SourceLocation const&);
+
+/** Line and column, both counted from 1. */
+struct Position {
+    unsigned line;
+    unsigned column;
+};
+
+struct Location {
+    Position begin;
+    Position end;
+};
+
+/**
+ * Lines of a source in memory, which must outlive the map. They are only
+ * looked for when the first location is asked for, so a source that
+ * compiles cleanly without debug info never goes through them.
+ */
+class SourceMap {
+public:
+    SourceMap(char const *data, size_t size);
+
+    SourceMap(SourceMap const&) = delete;
+    SourceMap& operator=(SourceMap const&) = delete;
+
+    Position locate(uint32_t offset) const;
+
+    /**
+     * Resolves loc against the current map of the thread, or to the first
+     * line and column if there is none.
+     */
+    static Location resolve(SourceLocation const& loc);
+
+    /** Map that locations on the current thread refer to, if any. */
+    static SourceMap const* current();
+
+    /** Makes map current for the thread, returns the previous one. */
+    static SourceMap const* setCurrent(SourceMap const* map);
+
+    /** Makes a map current for as long as it lives. */
+    class Use {
+    public:
+        Use(SourceMap const* map): previous(setCurrent(map)) {}
+        ~Use() { setCurrent(previous); }
+
+        Use(Use const&) = delete;
+        Use& operator=(Use const&) = delete;
+
+    private:
+        SourceMap const* previous;
+    };
+
+private:
+    char const *data;
+    size_t size;
+    // Offset of the first byte of each line.
+    mutable std::vector<uint32_t> starts;
+};
+
+} // monicelli
+
+#endif
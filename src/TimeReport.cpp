@@ -0,0 +1,205 @@
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "TimeReport.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <sys/resource.h>
+
+using namespace monicelli;
+
+static thread_local TimeReport *currentReport = nullptr;
+static thread_local TimeReport::Phase *currentPhase = nullptr;
+
+static
+double wallSeconds() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double>(now).count();
+}
+
+static
+double cpuSeconds() {
+    // Per thread, sources compiled in parallel do not add up.
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static
+long peakRssKiB() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static
+std::string jsonString(std::string const& value) {
+    std::string result = "\"";
+    for (char c: value) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            result += escape;
+        } else {
+            result += c;
+        }
+    }
+    return result + '"';
+}
+
+TimeReport::Phase::Phase(char const *name):
+        report(currentReport), name(name), parent(nullptr),
+        wallStart(0), cpuStart(0), nestedWall(0), nestedCpu(0) {
+    if (report == nullptr) return;
+
+    parent = currentPhase;
+    currentPhase = this;
+    wallStart = wallSeconds();
+    cpuStart = cpuSeconds();
+}
+
+TimeReport::Phase::~Phase() {
+    if (report == nullptr) return;
+
+    double wall = wallSeconds() - wallStart;
+    double cpu = cpuSeconds() - cpuStart;
+
+    if (parent != nullptr) {
+        parent->nestedWall += wall;
+        parent->nestedCpu += cpu;
+    }
+    currentPhase = parent;
+
+    report->addPhase(name, wall - nestedWall, cpu - nestedCpu);
+}
+
+TimeReport::TimeReport(std::string const& source): source(source) {}
+
+void TimeReport::addPhase(char const *name, double wall, double cpu) {
+    for (PhaseTotal &phase: phases) {
+        if (phase.name == name) {
+            phase.wall += wall;
+            phase.cpu += cpu;
+            ++phase.count;
+            return;
+        }
+    }
+
+    phases.push_back({name, wall, cpu, 1});
+}
+
+void TimeReport::addFunction(std::string const& name, double wall, size_t before, size_t after) {
+    functions.push_back({name, wall, before, after});
+}
+
+void TimeReport::print(std::ostream &stream) const {
+    stream << source << '\n' << std::fixed << std::setprecision(3);
+    stream << "  " << std::left << std::setw(20) << "phase" << std::right
+           << std::setw(12) << "wall (ms)" << std::setw(12) << "cpu (ms)" << '\n';
+
+    double wall = 0, cpu = 0;
+    for (PhaseTotal const& phase: phases) {
+        stream << "  " << std::left << std::setw(20) << phase.name << std::right
+               << std::setw(12) << phase.wall * 1e3 << std::setw(12) << phase.cpu * 1e3 << '\n';
+        wall += phase.wall;
+        cpu += phase.cpu;
+    }
+
+    stream << "  " << std::left << std::setw(20) << "total" << std::right
+           << std::setw(12) << wall * 1e3 << std::setw(12) << cpu * 1e3 << '\n';
+
+    if (functions.empty()) return;
+
+    stream << "  " << std::left << std::setw(20) << "function" << std::right
+           << std::setw(12) << "opt (ms)" << std::setw(28) << "instructions before/after" << '\n';
+
+    for (FunctionTotal const& function: functions) {
+        stream << "  " << std::left << std::setw(20) << function.name << std::right
+               << std::setw(12) << function.wall * 1e3
+               << std::setw(18) << function.before << " / " << std::setw(7) << function.after << '\n';
+    }
+}
+
+void TimeReport::printJson(std::ostream &stream) const {
+    stream << std::setprecision(9);
+    stream << "{\"source\": " << jsonString(source) << ", \"phases\": [";
+
+    for (size_t i = 0; i < phases.size(); ++i) {
+        PhaseTotal const& phase = phases[i];
+        stream << (i > 0? ", ": "")
+               << "{\"name\": " << jsonString(phase.name)
+               << ", \"wall_seconds\": " << phase.wall
+               << ", \"cpu_seconds\": " << phase.cpu
+               << ", \"count\": " << phase.count << '}';
+    }
+
+    stream << "], \"functions\": [";
+
+    for (size_t i = 0; i < functions.size(); ++i) {
+        FunctionTotal const& function = functions[i];
+        stream << (i > 0? ", ": "")
+               << "{\"name\": " << jsonString(function.name)
+               << ", \"optimize_seconds\": " << function.wall
+               << ", \"instructions_before\": " << function.before
+               << ", \"instructions_after\": " << function.after << '}';
+    }
+
+    stream << "]}";
+}
+
+TimeReport *TimeReport::current() {
+    return currentReport;
+}
+
+void TimeReport::setCurrent(TimeReport *report) {
+    currentReport = report;
+}
+
+void monicelli::printTimeReports(std::vector<TimeReport const*> const& reports, std::string const& format, std::ostream &stream) {
+    std::ios::fmtflags flags = stream.flags();
+    std::streamsize precision = stream.precision();
+
+    if (format == "json") {
+        stream << "{\"files\": [";
+        for (size_t i = 0; i < reports.size(); ++i) {
+            if (i > 0) stream << ", ";
+            reports[i]->printJson(stream);
+        }
+        stream << "], \"process_peak_rss_kib\": " << peakRssKiB() << '}' << std::endl;
+    } else {
+        for (TimeReport const *report: reports) {
+            report->print(stream);
+        }
+        stream << "process peak RSS: " << peakRssKiB() << " KiB" << std::endl;
+    }
+
+    stream.flags(flags);
+    stream.precision(precision);
+}
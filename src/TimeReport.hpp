@@ -0,0 +1,103 @@
+#ifndef TIME_REPORT_HPP
+#define TIME_REPORT_HPP
+
+/*
+ * Monicelli: an esoteric language compiler
+ * 
+ * Copyright (C) 2014 Stefano Sanfilippo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace monicelli {
+
+/**
+ * Time spent compiling one source, split by phase and function,
+ * as requested by --time-report.
+ */
+class TimeReport {
+public:
+    /**
+     * Measures a phase of the compilation, from construction to destruction,
+     * if a report is current on this thread. Time spent in phases nested in
+     * it is only accounted to those, so that phases add up.
+     */
+    class Phase {
+    public:
+        explicit Phase(char const *name);
+        ~Phase();
+
+        Phase(Phase const&) = delete;
+        Phase& operator=(Phase const&) = delete;
+
+    private:
+        TimeReport *report;
+        char const *name;
+        Phase *parent;
+        double wallStart, cpuStart;
+        double nestedWall, nestedCpu;
+    };
+
+    explicit TimeReport(std::string const& source);
+
+    std::string const& getSource() const {
+        return source;
+    }
+
+    void addFunction(std::string const& name, double wall, size_t before, size_t after);
+
+    void print(std::ostream &stream) const;
+    void printJson(std::ostream &stream) const;
+
+    /** Report that phases on this thread go to, nullptr if none. */
+    static TimeReport *current();
+    static void setCurrent(TimeReport *report);
+
+private:
+    struct PhaseTotal {
+        std::string name;
+        double wall;
+        double cpu;
+        unsigned count;
+    };
+
+    struct FunctionTotal {
+        std::string name;
+        double wall;
+        size_t before;
+        size_t after;
+    };
+
+    void addPhase(char const *name, double wall, double cpu);
+
+    std::string source;
+    std::vector<PhaseTotal> phases;
+    std::vector<FunctionTotal> functions;
+};
+
+/** Prints reports for all sources, as text or JSON depending on format. */
+/**
+ * Prints reports in format, followed by the peak RSS of the process, which
+ * cannot be told apart between sources compiled in parallel.
+ */
+void printTimeReports(std::vector<TimeReport const*> const& reports, std::string const& format, std::ostream &stream);
+
+}
+
+#endif
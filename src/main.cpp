@@ -24,7 +24,19 @@
 #include "ModuleLoader.hpp"
 #include "BitcodeEmitter.hpp"
 #include "CLineParser.hpp"
+#include "Diagnostics.hpp"
+#include "MappedFile.hpp"
+#include "SourceMap.hpp"
+#include "Cache.hpp"
+#include "TimeReport.hpp"
+#include "AstOptimizer.hpp"
+#include "SemanticAnalyzer.hpp"
+#include "JitRunner.hpp"
+#include "NativeLinker.hpp"
+#include "Server.hpp"
 
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
 #include <llvm/Bitcode/ReaderWriter.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/raw_os_ostream.h>
@@ -34,37 +46,147 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <vector>
 #include <functional>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <map>
+#include <unordered_set>
+#include <ctime>
+#include <cstdlib>
 
 using namespace monicelli;
 
 static const boost::regex NAME_RE("^(.+)\\.mc$");
 static const boost::regex MODULE_RE("^(.+)\\.mm$");
+static const boost::regex INDEX_RE("^(.+)\\.mmi$");
 
-int process(std::string const&, std::function<bool(std::ostream&, Program*)>);
+typedef std::function<bool(std::ostream&, Program*)> Writer;
 
+int process(std::string const&, Writer);
+int precompile();
+int runServer();
 
-int main(int argc, char **argv) {
-    parseCommandLine(argc, argv);
-    registerStdLib(getModuleRegistry());
+static
+bool emitProgram(Program *program, BitcodeEmitter &emitter) {
+    TimeReport::Phase phase("emit");
+    return program->emit(&emitter);
+}
+
+
+/**
+ * Writes objects to temporary files for link to read, which are removed
+ * afterwards.
+ */
+static
+bool linkObjects(std::vector<std::string> const& objects,
+                 std::function<bool(std::vector<std::string> const&)> const& link) {
+    std::vector<std::string> paths;
+    bool written = true;
+
+    for (std::string const& object: objects) {
+        boost::filesystem::path path = boost::filesystem::temp_directory_path()
+            / boost::filesystem::unique_path("mcc-%%%%-%%%%-%%%%.o");
+        paths.push_back(path.native());
+
+        std::ofstream objectstream(path.native(), std::ios::binary);
+        objectstream.write(object.data(), object.size());
+        written = written && objectstream;
+    }
+
+    bool success = written && link(paths);
+
+    for (std::string const& path: paths) {
+        boost::filesystem::remove(path);
+    }
+
+    return success;
+}
+
+static
+int runCommandLine(int argc, char **argv) {
+    try {
+        if (!parseCommandLine(argc, argv)) return 0;
+    } catch (boost::program_options::error const& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
 
-    if (!configHas("input")) {
+    if (configHas("server")) {
+        return runServer();
+    }
+
+    if (!configHas("input") && !configHas("pipe")) {
         std::cerr << "No input." << std::endl;
         return 0;
     }
 
-    if (configHas("c++")) {
+    if (configHas("precompile")) {
+        return precompile();
+    } else if (configHas("run")) {
+        return process("", [](std::ostream&, Program *program) {
+            llvm::LLVMContext context;
+            BitcodeEmitter emitter(context);
+            if (!emitProgram(program, emitter)) return false;
+
+            return runModule(emitter.takeModule(), getModuleRegistry().getLibraries(), configHas("run-times"));
+        });
+    } else if (configHas("c++") || configHas("c++-fast")) {
         return process("cpp", [](std::ostream &outstream, Program *program) {
-            CppEmitter emitter(&outstream);
+            TimeReport::Phase phase("emit");
+            CppEmitter emitter(&outstream, configHas("c++-fast"));
             if (!program->emit(&emitter)) return false;
             return true;
         });
+    } else if (configHas("object")) {
+        return process("o", [](std::ostream &outstream, Program *program) {
+            llvm::LLVMContext context;
+            BitcodeEmitter emitter(context);
+            if (!emitProgram(program, emitter)) return false;
+
+            std::vector<std::string> objects;
+            {
+                TimeReport::Phase phase("codegen");
+                if (!emitter.emitObjects(objects)) return false;
+            }
+
+            if (objects.size() == 1) {
+                outstream.write(objects.front().data(), objects.front().size());
+                return static_cast<bool>(outstream);
+            }
+
+            TimeReport::Phase phase("link");
+            return linkObjects(objects, [&](std::vector<std::string> const& paths) {
+                return linkRelocatable(paths, outstream);
+            });
+        });
+    } else if (configHas("exe")) {
+        return process("", [](std::ostream &outstream, Program *program) {
+            llvm::LLVMContext context;
+            BitcodeEmitter emitter(context);
+            if (!emitProgram(program, emitter)) return false;
+
+            std::vector<std::string> objects;
+            {
+                TimeReport::Phase phase("codegen");
+                if (!emitter.emitObjects(objects)) return false;
+            }
+
+            TimeReport::Phase phase("link");
+            return linkObjects(objects, [&](std::vector<std::string> const& paths) {
+                return linkExecutable(paths, outstream);
+            });
+        });
     } else {
         return process("bc", [](std::ostream & outstream, Program *program) {
-            BitcodeEmitter emitter;
-            if (!program->emit(&emitter)) return false;
+            llvm::LLVMContext context;
+            BitcodeEmitter emitter(context);
+            if (!emitProgram(program, emitter)) return false;
 
+            TimeReport::Phase phase("write");
             llvm::raw_os_ostream stream(outstream);
             llvm::WriteBitcodeToFile(&emitter.getModule(), stream);
 
@@ -73,55 +195,573 @@ int main(int argc, char **argv) {
     }
 }
 
-int process(std::string const& suffix, std::function<bool(std::ostream&, Program*)> writer) {
+int main(int argc, char **argv) {
+    registerStdLib(getModuleRegistry());
+    return runCommandLine(argc, argv);
+}
+
+struct LoadedModule {
+    std::time_t modified;
+    Pointer<ModuleRegistry> registry;
+};
+
+// Modules stay loaded as long as the process, which a server spends
+// answering many requests. They are loaded again when changed on disk.
+static
+ModuleRegistry* loadedModule(std::string const& name) {
+    static std::map<std::string, LoadedModule> loaded;
+
+    std::string path = boost::filesystem::canonical(name).native();
+    std::time_t modified = boost::filesystem::last_write_time(path);
+
+    LoadedModule &module = loaded[path];
+    if (module.registry && module.modified == modified) {
+        return module.registry.get();
+    }
+
+    Pointer<ModuleRegistry> registry(new ModuleRegistry);
+    if (!boost::regex_match(name, INDEX_RE)) {
+        loadModule(path, *registry);
+    } else if (!loadModuleIndex(path, *registry)) {
+        return nullptr;
+    }
+
+    module.modified = modified;
+    module.registry = std::move(registry);
+
+    return module.registry.get();
+}
+
+struct Job {
+    std::string source;
+    // Read length bytes from here rather than opening source.
+    std::istream *input = nullptr;
+    size_t length = std::string::npos;
+    // Write the output here, or to outputPath, rather than to a file
+    // named after source.
+    std::ostream *output = nullptr;
+    std::string outputPath;
+    std::ostringstream diagnostics;
+    Pointer<TimeReport> report;
+    bool success = false;
+};
+
+static
+std::string outputName(std::string const& source, std::string const& suffix) {
+    std::string outputname = boost::filesystem::path(source).filename().native();
+    std::string extension = suffix.empty()? "": '.' + suffix;
+
+    if (boost::regex_match(outputname, NAME_RE)) {
+        return boost::regex_replace(outputname, NAME_RE, "$1" + extension);
+    } else {
+        return outputname + extension;
+    }
+}
+
+static
+void makeExecutable(std::string const& name) {
+    if (configHas("exe")) {
+        using namespace boost::filesystem;
+        permissions(name, add_perms | owner_exe | group_exe | others_exe);
+    }
+}
+
+/**
+ * Collects every function of a streamed source before any is emitted,
+ * since functions may call others defined further down. Only the tokens
+ * of prototypes are looked at, the parser reports any malformed one.
+ */
+static
+void scanPrototypes(MappedFile const& source, PointerList<FunctionPrototype> &prototypes) {
+    typedef Parser::token token;
+
+    TimeReport::Phase phase("declare");
+    Scanner scanner(source.getData(), source.getSize());
+    Parser::semantic_type value;
+    Parser::location_type location;
+
+    int next = scanner.yylex(&value, &location);
+    auto advance = [&]() { next = scanner.yylex(&value, &location); };
+
+    while (next != 0) {
+        if (next != token::FUN_DECL) {
+            advance();
+            continue;
+        }
+
+        Parser::location_type begin = location;
+        Type type = Type::VOID;
+        advance();
+
+        if (next == token::TYPENAME) {
+            type = value.typeval;
+            advance();
+        }
+
+        if (next != token::ID) continue;
+        Symbol name = value.symval;
+        Pointer<PointerList<FunArg>> args(new PointerList<FunArg>());
+        advance();
+
+        if (next == token::PARAMS) {
+            do {
+                advance();
+                if (next == token::ARTICLE) advance();
+                if (next != token::ID) break;
+                Symbol arg = value.symval;
+
+                advance();
+                bool pointer = next == token::STAR;
+                if (pointer) advance();
+
+                if (next != token::TYPENAME) break;
+                args->push_back(new FunArg(new Id(arg), value.typeval, pointer));
+                advance();
+            } while (next == token::COMMA);
+        }
+
+        if (next != token::FUN_END) continue;
+
+        FunctionPrototype *proto = new FunctionPrototype(new Id(name), type, args.release());
+        proto->setLocation(begin);
+        prototypes.push_back(proto);
+        advance();
+    }
+}
+
+/**
+ * Copy of a streamed prototype on the heap, since its function and the
+ * arena it is allocated from are freed once emitted.
+ */
+static
+FunctionPrototype *copyPrototype(FunctionPrototype const& proto) {
+    Arena *previous = Arena::setCurrent(nullptr);
+
+    PointerList<FunArg> *args = new PointerList<FunArg>();
+    for (FunArg const& arg: proto.getArgs()) {
+        args->push_back(new FunArg(new Id(arg.getName().getSymbol()), arg.getType(), arg.isPointer()));
+    }
+
+    FunctionPrototype *copy = new FunctionPrototype(new Id(proto.getName().getSymbol()), proto.getType(), args);
+    copy->setLocation(proto.getSourceLocation());
+
+    Arena::setCurrent(previous);
+    return copy;
+}
+
+static
+bool compile(Job &job, std::string const& suffix, Writer const& writer, Cache *cache) {
+    std::string const& name = job.source;
+    MappedFile source;
+    bool opened;
+    {
+        TimeReport::Phase phase("read");
+        opened = job.input != nullptr? source.read(*job.input, job.length): source.open(name);
+    }
+
+    if (!opened && job.input != nullptr) {
+        diagnostics() << name + ": cannot read input" << std::endl;
+        return false;
+    }
+
+    if (!opened) {
+        diagnostics() << name + ": cannot open file" << std::endl;
+        return true;
+    }
+
+    bool run = configHas("run");
+    bool toFile = !run && job.output == nullptr;
+    std::string outputname;
+    std::string key;
+
+    if (toFile) {
+        outputname = job.outputPath.empty()? outputName(name, suffix): job.outputPath;
+    }
+
+    if (cache != nullptr && toFile) {
+        TimeReport::Phase phase("cache");
+        // Debug info names the source and the directory it is compiled in.
+        std::string origin;
+        if (configHas("debug")) {
+            origin = name + '\n' + boost::filesystem::current_path().native();
+        }
+        key = cache->getKey(source.getData(), source.getSize(), origin);
+        if (cache->fetch(key, outputname)) {
+            makeExecutable(outputname);
+            return true;
+        }
+    }
+
+    SourceMap lines(source.getData(), source.getSize());
+    SourceMap::Use use(&lines);
+
+    Program program;
+    program.setSource(name);
+    Scanner scanner(source.getData(), source.getSize());
+    Parser parser(scanner, program);
+
+#    if YYDEBUG
+    parser.set_debug_level(1);
+#    endif
+
+    bool simplify = !configHas("no-simplify");
+    SemanticAnalyzer analyzer;
+    // Callees of streamed calls, they must outlive the analysis.
+    PointerList<FunctionPrototype> prototypes;
+
+    if (configHas("stream") && !configHas("c++") && !configHas("c++-fast")) {
+        program.setStream([&](Program::Sink const& emit) {
+            scanPrototypes(source, prototypes);
+            std::unordered_set<Symbol> declared;
+            for (FunctionPrototype const& proto: prototypes) {
+                declared.insert(proto.getName().getSymbol());
+                analyzer.declare(proto);
+                if (!emit(proto)) return false;
+            }
+
+            program.streamTo([&](Function &function) {
+                // Missed by the scan, it is still callable from here on.
+                FunctionPrototype const& own = function.getPrototype();
+                if (declared.insert(own.getName().getSymbol()).second) {
+                    prototypes.push_back(copyPrototype(own));
+                    analyzer.declare(prototypes.back());
+                    if (!emit(prototypes.back())) return false;
+                }
+
+                if (simplify) {
+                    TimeReport::Phase phase("simplify");
+                    AstOptimizer().optimize(function);
+                }
+                {
+                    TimeReport::Phase phase("analyze");
+                    if (!analyzer.analyze(function)) return false;
+                }
+                return emit(function);
+            });
+
+            bool parsed;
+            {
+                TimeReport::Phase phase("parse");
+                parsed = parser.parse() == 0;
+            }
+
+            program.streamTo(nullptr);
+            return parsed;
+        });
+    } else {
+        {
+            TimeReport::Phase phase("parse");
+            if (parser.parse() != 0) return false;
+        }
+
+        if (simplify) {
+            TimeReport::Phase phase("simplify");
+            AstOptimizer().optimize(program);
+        }
+
+        TimeReport::Phase phase("analyze");
+        if (!analyzer.analyze(program)) return false;
+    }
+
+    if (run) {
+        std::ostream nowhere(nullptr);
+        return writer(nowhere, &program);
+    }
+
+    if (job.output != nullptr) {
+        return writer(*job.output, &program);
+    }
+
+    std::ofstream outstream(outputname, std::ios::binary);
+    bool success = writer(outstream, &program);
+    outstream.close();
+
+    if (success) {
+        makeExecutable(outputname);
+        if (!key.empty()) {
+            TimeReport::Phase phase("cache");
+            cache->store(key, outputname);
+        }
+    }
+
+    return success;
+}
+
+static
+void runJob(Job &job, std::string const& suffix, Writer const& writer, Cache *cache) {
+    if (configHas("time-report")) {
+        job.report.reset(new TimeReport(job.source));
+    }
+
+    setDiagnosticsStream(&job.diagnostics);
+    TimeReport::setCurrent(job.report.get());
+    job.success = compile(job, suffix, writer, cache);
+    TimeReport::setCurrent(nullptr);
+    setDiagnosticsStream(nullptr);
+}
+
+static
+int runJobs(std::vector<Job> &jobs, std::string const& suffix, Writer const& writer, Cache *cache) {
+    size_t workers = std::min<size_t>(config<unsigned>("jobs"), jobs.size());
+
+    // Programs are run one after another, never concurrently.
+    if (configHas("run")) workers = 1;
+
+    if (workers <= 1) {
+        for (Job &job: jobs) {
+            runJob(job, suffix, writer, cache);
+            std::cerr << job.diagnostics.str();
+            if (!job.success) return 1;
+        }
+        return 0;
+    }
+
+    // Each worker builds its own LLVMContext inside the writer, so sources
+    // can be processed concurrently. Diagnostics are buffered per source and
+    // printed in command line order once everybody is done.
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+
+    for (size_t i = 0; i < workers; ++i) {
+        pool.emplace_back([&]() {
+            for (size_t j = next++; j < jobs.size(); j = next++) {
+                runJob(jobs[j], suffix, writer, cache);
+            }
+        });
+    }
+
+    for (std::thread &worker: pool) {
+        worker.join();
+    }
+
+    int result = 0;
+    for (Job const& job: jobs) {
+        std::cerr << job.diagnostics.str();
+        if (!job.success) result = 1;
+    }
+
+    return result;
+}
+
+/**
+ * Compiles programs from standard input until it ends, each after a line
+ * with its length in bytes. The output of each is written to standard
+ * output after a line "ok LENGTH", or its diagnostics after "error LENGTH"
+ * if it does not compile.
+ */
+static
+int runPipe(std::string const& suffix, Writer const& writer) {
+    std::string header;
+
+    while (std::getline(std::cin, header)) {
+        if (header.empty()) continue;
+
+        char *end;
+        unsigned long long length = std::strtoull(header.c_str(), &end, 10);
+        if (end == header.c_str() || *end != '\0') {
+            std::cerr << "--pipe: expected the length of a program, got \"" + header + '"' << std::endl;
+            return 1;
+        }
+
+        std::ostringstream output;
+        Job job;
+        job.source = "<stdin>";
+        job.input = &std::cin;
+        job.length = length;
+        job.output = &output;
+        runJob(job, suffix, writer, nullptr);
+
+        std::string payload = job.success? output.str(): job.diagnostics.str();
+        if (job.success) std::cerr << job.diagnostics.str();
+
+        std::cout << (job.success? "ok ": "error ") << payload.size() << '\n';
+        std::cout.write(payload.data(), payload.size());
+        std::cout.flush();
+
+        if (job.report) {
+            printTimeReports({job.report.get()}, config<std::string>("time-report"), std::cerr);
+        }
+
+        // Cut short, the rest cannot be told apart from the next program.
+        if (!std::cin) return 1;
+    }
+
+    return 0;
+}
+
+int process(std::string const& suffix, Writer writer) {
     std::vector<std::string> sources;
     std::vector<std::string> modules;
+    std::vector<std::string> inputs;
 
-    for (std::string const& arg: config<std::vector<std::string>>("input")) {
-        if (boost::regex_match(arg, NAME_RE)) {
+    if (configHas("input")) {
+        inputs = config<std::vector<std::string>>("input");
+    }
+
+    for (std::string const& arg: inputs) {
+        if (arg == "-" || boost::regex_match(arg, NAME_RE)) {
             sources.push_back(arg);
-        } else if (boost::regex_match(arg, MODULE_RE)) {
+        } else if (boost::regex_match(arg, MODULE_RE) || boost::regex_match(arg, INDEX_RE)) {
             modules.push_back(arg);
         } else {
             std::cerr << arg + ": file format not recognized. Perhaps you forgot the .mc/.mm extension?" << std::endl;
         }
     }
 
+    ModuleRegistry registry;
+    registry.import(getModuleRegistry());
+
     for (std::string const& name: modules) {
-        loadModule(name, getModuleRegistry());
+        ModuleRegistry *module;
+        try {
+            module = loadedModule(name);
+        } catch (std::exception const& error) {
+            std::cerr << name + ": " + error.what() << std::endl;
+            return 1;
+        }
+
+        if (module == nullptr) {
+            std::cerr << name + ": not a valid module index" << std::endl;
+            return 1;
+        }
+
+        registry.import(*module);
     }
 
-    for (std::string const& name: sources) {
-        std::ifstream instream(name);
+    // Memoized functions are found over the whole program, which a streamed
+    // one never is.
+    if (configHas("memoize") && configHas("stream")) {
+        std::cerr << "--memoize cannot be used with --stream." << std::endl;
+        return 1;
+    }
 
-        if (!instream.good()) {
-            std::cerr << name + ": cannot open file" << std::endl;
-            continue;
-        }
+    bool pipe = configHas("pipe");
 
-        Program program;
-        Scanner scanner(&instream);
-        Parser parser(scanner, program);
+    if (pipe && (!sources.empty() || configHas("output") || configHas("run"))) {
+        std::cerr << "--pipe reads sources from standard input and writes to standard output." << std::endl;
+        return 1;
+    }
 
-#    if YYDEBUG
-        parser.set_debug_level(1);
-#    endif
+    if (configHas("output") && sources.size() > 1) {
+        std::cerr << "-o can only be used with one source." << std::endl;
+        return 1;
+    }
+
+    if (std::count(sources.begin(), sources.end(), "-") > 1) {
+        std::cerr << "Standard input can only be read once." << std::endl;
+        return 1;
+    }
 
-        parser.parse();
+    std::vector<Job> jobs(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) {
+        Job &job = jobs[i];
+        std::string output = configHas("output")? config<std::string>("output"): "";
 
-        std::string outputname = boost::filesystem::path(name).filename().native();
+        if (sources[i] == "-") {
+            job.source = "<stdin>";
+            job.input = &std::cin;
+            if (output.empty()) output = "-";
+        } else {
+            job.source = sources[i];
+        }
 
-        if (boost::regex_match(outputname, NAME_RE)) {
-            outputname = boost::regex_replace(outputname, NAME_RE, "$1." + suffix);
+        if (output == "-") {
+            job.output = &std::cout;
         } else {
-            outputname = outputname + '.' + suffix;
+            job.outputPath = output;
+        }
+    }
+
+    Pointer<Cache> cache;
+    if (configHas("cache-dir") && !configHas("run")) {
+        uintmax_t capacity = uintmax_t(config<unsigned>("cache-size")) << 20;
+        cache.reset(new Cache(config<std::string>("cache-dir"), capacity));
+        for (std::string const& name: modules) {
+            cache->addModule(name);
         }
+        for (std::string const& name: getLinkedLibraries()) {
+            cache->addModule(name);
+        }
+        // Linked into every executable, as with -lmcrt.
+        if (configHas("exe")) {
+            cache->addModule(config<std::string>("runtime-path") + "/libmcrt.a");
+        }
+        if (configHas("profile-use")) {
+            cache->addModule(config<std::string>("profile-use"));
+        }
+    }
 
-        std::ofstream outstream(outputname);
+    ModuleRegistry *previous = setModuleRegistry(&registry);
+    int result = pipe? runPipe(suffix, writer): runJobs(jobs, suffix, writer, cache.get());
+    setModuleRegistry(previous);
 
-        if (!writer(outstream, &program)) return 1;
+    // Piped programs have already been reported one by one.
+    if (configHas("time-report") && !pipe) {
+        std::vector<TimeReport const*> reports;
+        for (Job const& job: jobs) {
+            if (job.report) reports.push_back(job.report.get());
+        }
+        printTimeReports(reports, config<std::string>("time-report"), std::cerr);
     }
 
-    return 0;
+    if (cache) {
+        cache->evict();
+        if (configHas("cache-stats")) cache->printStats(std::cerr);
+    }
+
+    return result;
 }
 
+int precompile() {
+    int result = 0;
+
+    for (std::string const& arg: config<std::vector<std::string>>("input")) {
+        if (!boost::regex_match(arg, MODULE_RE)) {
+            std::cerr << arg + ": only .mm modules can be precompiled" << std::endl;
+            result = 1;
+            continue;
+        }
+
+        std::string outputname = boost::filesystem::path(arg).filename().native() + 'i';
+        if (!precompileModule(arg, outputname)) {
+            std::cerr << arg + ": cannot write " + outputname << std::endl;
+            result = 1;
+        }
+    }
+
+    return result;
+}
+
+int runServer() {
+    static bool serving = false;
+
+    if (serving) {
+        std::cerr << "Already running as a server." << std::endl;
+        return 1;
+    }
+    serving = true;
+
+    std::string path = config<std::string>("server");
+    if (path.empty()) path = defaultServerSocket();
+
+    // Requests are handled in a child process, only what is loaded here,
+    // before forking, is still there for the next request.
+    auto prepare = [](ServerRequest const& request) {
+        for (std::string const& arg: request.arguments) {
+            if (!boost::regex_match(arg, MODULE_RE) && !boost::regex_match(arg, INDEX_RE)) continue;
+            try {
+                ModuleRegistry *module = loadedModule(boost::filesystem::absolute(arg, request.directory).native());
+                // Opened here, the libraries are already there for every --run.
+                if (module != nullptr) {
+                    for (std::string const& library: module->getLibraries()) {
+                        loadLibrary(library);
+                    }
+                }
+            } catch (std::exception const&) {
+                // Reported by the request itself, to the client.
+            }
+        }
+    };
+
+    return monicelli::serve(path, prepare, runCommandLine);
+}
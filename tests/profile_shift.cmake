@@ -0,0 +1,54 @@
+#
+# Monicelli: an esoteric language compiler
+# 
+# Copyright (C) 2014 Stefano Sanfilippo
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+
+# A profile of SOURCE must still apply once a line is inserted above its
+# functions. Run as cmake -DMCC=... -DSOURCE=... -DWORK=... -P this file.
+
+function(mcc)
+    execute_process(COMMAND ${MCC} ${ARGN} RESULT_VARIABLE result OUTPUT_QUIET)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "mcc ${ARGN} failed")
+    endif()
+endfunction()
+
+file(MAKE_DIRECTORY ${WORK})
+set(PROFILE ${WORK}/profile.txt)
+file(REMOVE ${PROFILE})
+
+mcc(--run --profile-generate=${PROFILE} ${SOURCE})
+
+file(READ ${SOURCE} contents)
+file(WRITE ${WORK}/shifted.mc "bituma una riga in più\n${contents}")
+
+mcc(-o ${WORK}/plain.bc ${SOURCE})
+mcc(--profile-use ${PROFILE} -o ${WORK}/original.bc ${SOURCE})
+mcc(--profile-use ${PROFILE} -o ${WORK}/shifted.bc ${WORK}/shifted.mc)
+
+file(SHA256 ${WORK}/plain.bc plain)
+file(SHA256 ${WORK}/original.bc original)
+file(SHA256 ${WORK}/shifted.bc shifted)
+
+if (original STREQUAL plain)
+    message(FATAL_ERROR "the profile was not used at all")
+endif()
+
+if (NOT original STREQUAL shifted)
+    message(FATAL_ERROR "the profile no longer applies after inserting a line")
+endif()